@@ -0,0 +1,805 @@
+#include "Editor.h"
+
+#include <Eigen/Geometry> 
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <sstream>
+#include <string>
+
+#include "alloc_counter.h"
+
+using namespace Eigen;
+
+/* Wrapper class to store types of modes and keys */
+class EditorMode {
+public:
+    const static char INSERTION_MODE_KEY = 'i', TRANSLATION_MODE_KEY = 'o', DELETE_MODE_KEY = 'p', COLOR_MODE_KEY = 'c', ANIMATION_MODE_KEY = 'm';
+    const static char SCALE_UP = 'k', SCALE_DOWN = 'l', ROTATE_CLOCKWISE = 'h', ROTATE_COUNTERCLOCKWISE = 'j';
+    const static char PAN_DOWN_KEY = 'w', PAN_UP_KEY = 's', PAN_LEFT_KEY = 'd', PAN_RIGHT_KEY = 'a', ZOOM_IN_KEY = 'W', ZOOM_OUT_KEY = 'V';
+    const static char HEATMAP_KEY = 'f', STATS_KEY = 't';
+};
+
+/* Color Constants */
+const static Vector4f RED = Vector4f(1, 0, 0, 1);
+const static Vector4f GREEN = Vector4f(0, 1, 0, 1);
+const static Vector4f BLUE = Vector4f(0, 0, 1, 1);
+const static Vector4f HIGHLIGHT = Vector4f(0.5, 0.8, 0, 1);
+
+/*String Constants */
+const static std::string WELCOME_MSG = "Welcome to 2D Editor. \nThe mode & respective keys are:\n 1. Insertion Mode = i \n 2. Translation Mode = o \n 3. Delete Mode = p \n 4. Color Mode = c  \n 5. Animation Mode = m\n******************************\nYou are currently in insertion mode. Please select vertices to draw a triangle.\n******************************\n";
+const static std::string INSERTION_MODE_MSG = "You are in Insertion Mode.\n";
+const static std::string TRANSLATION_MODE_MSG = "\nYou are in Translation Mode.\n You can: \n 1. Use cursor to move triangles\n 2. Scale up = k\n 3. Scale down = l\n 4. Rotate clockwise = h\n 5. Rotate anti-clockwise\n";
+const static std::string DELETION_MODE_MSG = "\nYou are in Deletion Mode. Click on a triangle to delete. \n";
+const static std::string COLOR_MODE_MSG = "\nYou are in Color Mode. Click inside a triangle to color the closest vertex. \n";
+const static std::string ANIMATION_MODE_MSG = "\nYou are in Animation Mode.\n Now, you should move the triangle to whichever position you like. \n Use key 'n' for linear interpolation animation\n Use key 'b' for Beizer Curve Interpolation animation\n";
+const static std::string ZOOM_OUT_MSG = "\nZooming Out";
+const static std::string ZOOM_IN_MSG = "\nZooming In";
+const static std::string PAN_DOWN_MSG = "\nPanning down";
+const static std::string PAN_UP_MSG = "\nPanning up";
+const static std::string PAN_RIGHT_MSG = "\nPanning right";
+const static std::string PAN_LEFT_MSG = "\nPanning left";
+const static std::string HEATMAP_SHADED_MSG = "\nHeatmap of the shaded fragments per pixel (black 0, blue 1, ... white 8+). Press f again for the tested fragments.\n";
+const static std::string HEATMAP_TESTED_MSG = "\nHeatmap of the tested fragments per pixel. Press f again to go back to the scene.\n";
+const static std::string HEATMAP_OFF_MSG = "\nHeatmap off.\n";
+const static std::string STATS_ON_MSG = "\nStatistics graph on, press t again to hide it and print the averages.\n";
+
+/* Statistics graph: bars of 2 pixels per frame, 60 pixels high for 33.3 ms, with a line at 16.7 ms */
+const static int STATS_BAR_WIDTH = 2;
+const static int STATS_GRAPH_HEIGHT = 60;
+const static uint64_t STATS_GRAPH_NS = 33333333;
+const static FrameBufferAttributes STATS_BACKGROUND(32, 32, 32, 255);
+const static FrameBufferAttributes STATS_REFERENCE(255, 255, 255, 255);
+// One color per stage: clear, vertex, setup, raster, convert, present, then the rest of the frame
+const static FrameBufferAttributes STATS_COLORS[STAGE_COUNT + 1] = {
+    FrameBufferAttributes(220, 50, 50, 255), FrameBufferAttributes(230, 200, 40, 255), FrameBufferAttributes(240, 130, 30, 255),
+    FrameBufferAttributes(60, 200, 60, 255), FrameBufferAttributes(40, 200, 220, 255), FrameBufferAttributes(200, 70, 220, 255),
+    FrameBufferAttributes(130, 130, 130, 255)
+};
+
+/* Identity Matrix constant */
+const static Matrix4f identity = Matrix4f::Identity();
+
+/* Method to print string message */
+void printMessage(std::string message) {
+    std::cout << message;
+}
+
+/* Method to print the average statistics of the last frames recorded */
+void printStats(const FrameStatsHistory& stats) {
+    const FrameStats average = stats.average(stats.capacity());
+    std::ostringstream message;
+    message << "\nStatistics graph off. Average of the last " << stats.size() << " frames recorded:\n";
+    message << " frame " << average.frame_ns / 1e6 << " ms\n";
+    for (int s = 0; s < STAGE_COUNT; s++)
+        message << " " << pipeline_stage_name(PipelineStage(s)) << " " << average.stage_ns[s] / 1e6 << " ms\n";
+    message << " triangles " << average.triangles_submitted << " submitted, " << average.triangles_culled << " culled\n";
+    message << " lines " << average.lines_submitted << "\n";
+    message << " pixels " << average.pixels_tested << " tested, " << average.pixels_shaded << " shaded\n";
+    printMessage(message.str());
+}
+
+/* Method to print vector while debugging */
+void printVector(Vector4f& v) {
+    std::cout << "\n[" << v.x() << ", " << v.y() << ", " << v.z() << ", " << v.w() << "]";
+}
+
+/* Method to set color */
+void setColor(VertexAttributes& v1, VertexAttributes& v2, VertexAttributes& v3, Vector4f color) {
+    v1.color = color;
+    v2.color = color;
+    v3.color = color;
+}
+
+/* Method to get 4f to 3d Vector */
+Vector3d get3DPositionVector(Vector4f& temp) {
+    return Vector3d(temp.x(), temp.y(), temp.z());
+}
+
+/* Method to get index of selected triangle based on clicked position */
+int getSelectedTriangleIndex(std::vector<VertexAttributes>& triangles, UniformAttributes& uniform, double x_pos, double y_pos) {
+    for (unsigned i = 0; i + 2 < triangles.size(); i += 3) {
+        Vector4f v1_pos = uniform.view * uniform.translate * uniform.rotate * uniform.scale * triangles[i].position;
+        Vector4f v2_pos = uniform.view * uniform.translate * uniform.rotate * uniform.scale * triangles[i + 1].position;
+        Vector4f v3_pos = uniform.view * uniform.translate * uniform.rotate * uniform.scale * triangles[i + 2].position;
+
+        Vector3d v1 = get3DPositionVector(v1_pos);
+        Vector3d v2 = get3DPositionVector(v2_pos);
+        Vector3d v3 = get3DPositionVector(v3_pos);
+
+        AlignedBox3d box;
+        box = box.extend(v1);
+        box = box.extend(v2);
+        box = box.extend(v3);
+        if (box.contains(Vector3d(x_pos, y_pos, 0))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Method to delete triangle based on click position */
+void deleteTriangle(std::vector<VertexAttributes>& triangles, UniformAttributes& uniform, double x_pos, double y_pos, bool& redrawNext) {
+    int index = getSelectedTriangleIndex(triangles, uniform, x_pos, y_pos);
+    if (index >= 0) {
+        triangles.erase(triangles.begin() + index, triangles.begin() + index + 3);
+        uniform.view << identity;
+        uniform.translate << identity;
+        uniform.rotate << identity;
+        uniform.scale << identity;
+        uniform.scale_factor = 1.00;
+        uniform.rotate_radians = 0.0;
+        uniform.translate_delta = Vector4f(0.0, 0.0, 0.0, 0.0);
+        redrawNext = true;
+    }
+}
+
+/* Method to set current editor mode */
+void setCurrentMode(char key, Mode& currentMode) {
+    if (key == EditorMode::INSERTION_MODE_KEY) { //Insertion Mode
+        printMessage(INSERTION_MODE_MSG);
+        currentMode = INSERTION_MODE;
+    }
+    else if (key == EditorMode::TRANSLATION_MODE_KEY) { //Translation Mode
+        printMessage(TRANSLATION_MODE_MSG);
+        currentMode = TRANSLATION_MODE;
+    }
+    else if (key == EditorMode::DELETE_MODE_KEY) { //Deletion Mode
+        printMessage(DELETION_MODE_MSG);
+        currentMode = DELETION_MODE;
+    }
+    else if (key == EditorMode::COLOR_MODE_KEY) { //Color Mode
+        printMessage(COLOR_MODE_MSG);
+        currentMode = COLOR_MODE;
+    }
+    else if (key == EditorMode::ANIMATION_MODE_KEY) { //Animation Mode
+        printMessage(ANIMATION_MODE_MSG);
+        currentMode = TRANSLATION_MODE;
+    }
+}
+
+/* Method to translate selected triangle */
+void translateTriangle(VertexAttributes& v1, VertexAttributes& v2, VertexAttributes& v3, UniformAttributes& uniform) {
+    v1.selected = true;
+    v2.selected = true;
+    v3.selected = true;
+    Matrix4f currentTransform;
+    currentTransform <<     1, 0, 0, uniform.translate_delta.x(),
+                            0, 1, 0, uniform.translate_delta.y(),
+                            0, 0, 1, 0,
+                            0, 0, 0, 1;
+    uniform.translate = currentTransform * uniform.translate;
+}
+
+/* Method to scale selected triangle */
+void scaleTriangle(VertexAttributes& v1, VertexAttributes& v2, VertexAttributes& v3, UniformAttributes& uniform) {
+    v1.selected = true;
+    v2.selected = true;
+    v3.selected = true;
+
+    Matrix4f currentTransform;
+    currentTransform << uniform.scale_factor, 0, 0, 0,
+                        0, uniform.scale_factor, 0, 0,
+                        0, 0, 1, 0,
+                        0, 0, 0, 1;
+    uniform.scale = currentTransform * uniform.scale;
+}
+
+/* Method to rotate selected triangle */
+void rotateTriangle(VertexAttributes& v1, VertexAttributes& v2, VertexAttributes& v3, UniformAttributes& uniform) {
+    v1.selected = true;
+    v2.selected = true;
+    v3.selected = true;
+    double cos_rotate_degree = cos(uniform.rotate_radians), sin_rotate_degree = sin(uniform.rotate_radians);
+    Matrix4f currentTransform;
+    currentTransform <<     cos_rotate_degree, -sin_rotate_degree, 0, 0,
+                            sin_rotate_degree, cos_rotate_degree, 0, 0,
+                            0, 0, 1, 0,
+                            0, 0, 0, 1;
+    uniform.rotate = currentTransform * uniform.rotate;
+}
+
+/* Method to perform translations triangle */
+void performTranslationAction(char key, std::vector<VertexAttributes>& triangles, UniformAttributes& uniform, int triangleToTranslate) {
+    switch (key) {
+    case EditorMode::SCALE_UP:
+        if (uniform.scale_factor < 1)
+            uniform.scale_factor = 1;
+        uniform.scale_factor += 0.25;
+        uniform.mode = EditorMode::SCALE_UP;
+        scaleTriangle(triangles[triangleToTranslate], triangles[triangleToTranslate + 1], triangles[triangleToTranslate + 2], uniform);
+        break;
+    case EditorMode::SCALE_DOWN:
+        if (uniform.scale_factor > 1)
+            uniform.scale_factor = 1;
+        uniform.scale_factor -= 0.25;
+        uniform.mode = EditorMode::SCALE_DOWN;
+        scaleTriangle(triangles[triangleToTranslate], triangles[triangleToTranslate + 1], triangles[triangleToTranslate + 2], uniform);
+        break;
+    case EditorMode::ROTATE_CLOCKWISE:
+        if (uniform.rotate_radians < 0)
+            uniform.rotate_radians = 0;
+        uniform.rotate_radians += 0.17453292519;
+        uniform.mode = EditorMode::ROTATE_CLOCKWISE;
+        rotateTriangle(triangles[triangleToTranslate], triangles[triangleToTranslate + 1], triangles[triangleToTranslate + 2], uniform);
+        break;
+    case EditorMode::ROTATE_COUNTERCLOCKWISE:
+        if (uniform.rotate_radians > 0)
+            uniform.rotate_radians = 0;
+        uniform.rotate_radians -= 0.17453292519;
+        uniform.mode = EditorMode::ROTATE_COUNTERCLOCKWISE;
+        rotateTriangle(triangles[triangleToTranslate], triangles[triangleToTranslate + 1], triangles[triangleToTranslate + 2], uniform);
+        break;
+    }
+}
+
+/* Method to get nearest vertex */
+int getNearestVertex(std::vector<VertexAttributes>& triangles, UniformAttributes& uniform, int selectedTriangle, Vector4f currPosition) {
+    Vector4f v1 = uniform.view * uniform.translate * uniform.rotate * uniform.scale * triangles[selectedTriangle].position;
+    Vector4f v2 = uniform.view * uniform.translate * uniform.rotate * uniform.scale * triangles[selectedTriangle + 1].position;
+    Vector4f v3 = uniform.view * uniform.translate * uniform.rotate * uniform.scale * triangles[selectedTriangle + 2].position;
+    std::vector<double> dist = {    (v1 - currPosition).norm(),
+                                    (v2 - currPosition).norm(),
+                                    (v3 - currPosition).norm()
+    };
+    return std::min_element(dist.begin(), dist.end()) - dist.begin() + selectedTriangle;
+}
+
+/* Method to update viewport */
+void changeViewport(char key, float zoom, float delta, UniformAttributes& uniform, bool& redrawNext) {
+    char temp_key = uniform.mode;
+    uniform.mode = key;
+    //Zooming & Paning function
+    if (key == EditorMode::ZOOM_IN_KEY) {
+        printMessage(ZOOM_OUT_MSG);
+        if (zoom < 1)
+            zoom = 1;
+        zoom += 0.2;
+        Matrix4f currentView;
+        currentView << zoom, 0, 0, 0,
+            0, zoom, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1;
+        uniform.view = currentView * uniform.view;
+        redrawNext = true;
+    }
+    else if (key == EditorMode::ZOOM_OUT_KEY) {
+        printMessage(ZOOM_IN_MSG);
+        if (zoom > 1)
+            zoom = 1;
+        zoom -= 0.2;
+        Matrix4f currentView;
+        currentView << zoom, 0, 0, 0,
+            0, zoom, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1;
+        uniform.view = currentView * uniform.view;
+        redrawNext = true;
+    }
+    else if (key == EditorMode::PAN_DOWN_KEY) {
+        uniform.mode = 'w';
+        printMessage(PAN_DOWN_MSG);
+        if (delta > 0)
+            delta = 0;
+        delta -= 0.2;
+        Matrix4f currentView;
+        currentView << 1, 0, 0, 0,
+            0, 1, 0, delta,
+            0, 0, 1, 0,
+            0, 0, 0, 1;
+        uniform.view = currentView * uniform.view;
+        redrawNext = true;
+    }
+    else if (key == EditorMode::PAN_UP_KEY) {
+        printMessage(PAN_UP_MSG);
+        if (delta < 0)
+            delta = 0;
+        delta += 0.2;
+        Matrix4f currentView;
+        currentView << 1, 0, 0, 0,
+            0, 1, 0, delta,
+            0, 0, 1, 0,
+            0, 0, 0, 1;
+        uniform.view = currentView * uniform.view;
+        redrawNext = true;
+    }
+    else if (key == EditorMode::PAN_RIGHT_KEY) {
+        printMessage(PAN_RIGHT_MSG);
+        if (delta < 0)
+            delta = 0;
+        delta += 0.2;
+        Matrix4f currentView;
+        currentView << 1, 0, 0, delta,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1;
+        uniform.view = currentView * uniform.view;
+        redrawNext = true;
+    }
+    else if (key == EditorMode::PAN_LEFT_KEY) {
+        printMessage(PAN_LEFT_MSG);
+        if (delta > 0)
+            delta = 0;
+        delta -= 0.2;
+        Matrix4f currentView;
+        currentView << 1, 0, 0, delta,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1;
+        uniform.view = currentView * uniform.view;
+        redrawNext = true;
+    }
+    else {
+        uniform.mode = temp_key;
+        return;
+    }
+}
+
+VertexAttributes EditorVertexShader::operator()(const VertexAttributes& va, const UniformAttributes& uniform) const {
+    VertexAttributes v_new = va;
+    if (va.selected) {
+        if (uniform.mode == EditorMode::ROTATE_CLOCKWISE || uniform.mode == EditorMode::ROTATE_COUNTERCLOCKWISE 
+            || uniform.mode == EditorMode::SCALE_DOWN || uniform.mode == EditorMode::SCALE_UP) {
+            Matrix4f currentTransform;
+            currentTransform << 1, 0, 0, -v_new.bary_center.x(),
+                                0, 1, 0, -v_new.bary_center.y(),
+                                0, 0, 1, 0,
+                                0, 0, 0, 1;
+            v_new.position = currentTransform * v_new.position;
+            v_new.position = uniform.view * uniform.translate * uniform.rotate * uniform.scale * v_new.position;
+            Matrix4f currentTransform2;
+            currentTransform2 << 1, 0, 0, v_new.bary_center.x(),
+                                0, 1, 0, v_new.bary_center.y(),
+                                0, 0, 1, 0,
+                                0, 0, 0, 1;
+            v_new.position = currentTransform2 * v_new.position;
+        }
+        else {
+            v_new.position = uniform.view * uniform.translate * uniform.rotate * uniform.scale * v_new.position;
+        }
+    }
+    else {
+        v_new.position = uniform.view * uniform.translate * uniform.rotate * uniform.scale * v_new.position;
+    }
+    return v_new;
+}
+
+void EditorFragmentShader::operator()(const FragmentSpan& span, const UniformAttributes&, FragmentAttributes* fragments) const {
+    Vector4f color = span.start.color;
+    for (int k = 0; k < span.count; k++) {
+        fragments[k].color = color;
+        color += span.dx.color;
+    }
+}
+
+Editor::Editor(int width, int height)
+    : redrawNext(false), width(width), height(height), frameBuffer(width, height), depthBuffer(width, height),
+      overdraw(width, height), heatmapMode(0),
+      program(make_span_program(EditorVertexShader(), EditorFragmentShader(), SpanBlender(BLEND_SOURCE_OVER))),
+      currentMode(INSERTION_MODE), numOfClicks(0), selectedTriangle(-1), prevClickedTriangle(-1),
+      isClicked(false), isCursorMoving(false), firstTime(true), vertex_index(-1), zoom(1), delta(0.0),
+      animationMode(false), isPositionSet(false), outline(4), preview(&noPreview), previewStrip(false),
+      previewThickness(1.0), backgroundLayer(width, height), backgroundEdited(-1), statsOverlay(false), statsRecording(false) {
+    uniform.view << identity;
+    uniform.translate << identity;
+    uniform.rotate << identity;
+    uniform.scale << identity;
+    uniform.scale_factor = 1.00;
+    uniform.rotate_radians = 0.0;
+    uniform.translate_delta = Vector4f(0.0, 0.0, 0.0, 0.0);
+    dirtyRects.reserve(dirty.rects.capacity());
+    printMessage(WELCOME_MSG);
+}
+
+void Editor::setTriangles(const std::vector<VertexAttributes>& scene) {
+    triangles = scene;
+    for (unsigned i = 0; i + 2 < triangles.size(); i += 3) {
+        Vector4f bary_center = (triangles[i].position + triangles[i + 1].position + triangles[i + 2].position) / 3;
+        for (int k = 0; k < 3; k++)
+            triangles[i + k].bary_center = bary_center;
+    }
+    numOfClicks = 0;
+    lines.clear();
+    triangleVertices.clear();
+    selectedTriangle = -1;
+    prevClickedTriangle = -1;
+    vertex_index = -1;
+    isClicked = false;
+    isCursorMoving = false;
+    animation.running = false;
+    redrawNext = true;
+}
+
+void Editor::mouseMove(int x, int y) {
+    float x_pos = (float(x) / float(width) * 2) - 1;
+    float y_pos = (float(height - 1 - y) / float(height) * 2) - 1;
+    if (currentMode == INSERTION_MODE) {
+        if (numOfClicks % 3 != 0) {
+            if(lines.size() > 1)
+                lines.pop_back();
+            lines.push_back(VertexAttributes(x_pos, y_pos, 0, 1));
+            redrawNext = true;
+        }
+    }
+    else if (currentMode == TRANSLATION_MODE) {
+        if (isClicked && selectedTriangle >= 0) {
+            isCursorMoving = true;
+            newPosition = Vector4f(x_pos, y_pos, 0, 1);
+            if (animationMode && !isPositionSet) {
+                oldAnimePosition1 = uniform.view * uniform.rotate * uniform.scale * triangles[selectedTriangle].position;
+                oldAnimePosition2 = uniform.view * uniform.rotate * uniform.scale * triangles[selectedTriangle + 1].position;
+                oldAnimePosition3 = uniform.view * uniform.rotate * uniform.scale * triangles[selectedTriangle + 2].position;
+                isPositionSet = true;
+            }
+            uniform.translate_delta = newPosition - oldPosition;
+            oldPosition = newPosition;
+            firstTime = false;
+            uniform.mode = EditorMode::TRANSLATION_MODE_KEY;
+            translateTriangle(triangles[selectedTriangle], triangles[selectedTriangle + 1], triangles[selectedTriangle + 2], uniform);
+            redrawNext = true;
+        }
+    }
+}
+
+void Editor::mousePressed(int x, int y, bool mouseButtonUp) {
+    float x_pos = (float(x) / float(width) * 2) - 1;
+    float y_pos = (float(height - 1 - y) / float(height) * 2) - 1;
+    if (currentMode == INSERTION_MODE) {
+        if (mouseButtonUp) {
+            lines.push_back(VertexAttributes(x_pos, y_pos, 0, 1));
+            triangleVertices.push_back(VertexAttributes(x_pos, y_pos, 0, 1));
+            numOfClicks += 1;
+            redrawNext = true;
+        }
+    }
+    else if (currentMode == DELETION_MODE) {
+        deleteTriangle(triangles, uniform, x_pos, y_pos, redrawNext);
+    }
+    else if(currentMode == TRANSLATION_MODE) {
+        //Get the selected triangle
+        selectedTriangle = getSelectedTriangleIndex(triangles, uniform, x_pos, y_pos);
+        
+        //If no triangle selected but was previously selected, make it blue now
+        if (selectedTriangle < 0) { 
+            if (prevClickedTriangle >= 0) {
+                setColor(triangles[prevClickedTriangle], triangles[prevClickedTriangle + 1], triangles[prevClickedTriangle + 2], BLUE);
+                isClicked = false;
+                isCursorMoving = false;
+                prevClickedTriangle = -1;
+                redrawNext = true;
+            }
+        }
+        else {
+            //After mouse button is released
+            if (mouseButtonUp) {
+                //Check if it was dragged or selected
+                if (isClicked) {
+                    //If it was dragged
+                    if (isCursorMoving) {
+                        isClicked = false;
+                        isCursorMoving = false;
+                        oldPosition = newPosition;
+                        firstTime = true;
+                        redrawNext = true;
+                    }
+                    else {
+                        isClicked = false;
+                        redrawNext = true;
+                    }
+                }
+            }
+            //When mouse button is pressed (not released yet)
+            else {
+                //If a triangle was selected
+                if (selectedTriangle >= 0) {
+                    oldPosition = Vector4f(x_pos, y_pos, 0, 1);
+                    prevClickedTriangle = selectedTriangle;
+                    setColor(triangles[selectedTriangle], triangles[selectedTriangle + 1], triangles[selectedTriangle + 2], HIGHLIGHT);
+                    isClicked = true;
+                    redrawNext = true;
+                }
+            }
+        }
+    }
+    else if (currentMode == COLOR_MODE) {
+        selectedTriangle = getSelectedTriangleIndex(triangles, uniform, x_pos, y_pos);
+        if (selectedTriangle >= 0) {
+            vertex_index = getNearestVertex(triangles, uniform, selectedTriangle, Vector4f(x_pos, y_pos, 0, 1));
+        }
+    }
+}
+
+void Editor::keyPressed(char key) {
+    
+    setCurrentMode(key, currentMode); //Setting current mode
+
+    if (key == EditorMode::HEATMAP_KEY) {
+        heatmapMode = (heatmapMode + 1) % 3;
+        printMessage(heatmapMode == 1 ? HEATMAP_SHADED_MSG : (heatmapMode == 2 ? HEATMAP_TESTED_MSG : HEATMAP_OFF_MSG));
+        set_overdraw_buffer(heatmapMode ? &overdraw : nullptr);
+        redrawNext = true;
+    }
+
+    if (key == EditorMode::STATS_KEY) {
+        statsOverlay = !statsOverlay;
+        if (statsOverlay)
+            printMessage(STATS_ON_MSG);
+        else
+            printStats(stats);
+        dirty.invalidate();
+        redrawNext = true;
+    }
+
+    if (key == EditorMode::ANIMATION_MODE_KEY) {
+        animationMode = true;
+    }
+
+    if (animationMode) {
+        oldAnimePosition1 = triangles[selectedTriangle].position;
+        oldAnimePosition2 = triangles[selectedTriangle + 1].position;
+        oldAnimePosition3 = triangles[selectedTriangle + 2].position;
+        Vector4f temp1 = (uniform.view * uniform.translate * uniform.rotate * uniform.scale * triangles[selectedTriangle].position) - oldAnimePosition1;
+        Vector4f temp2 = (uniform.view * uniform.translate * uniform.rotate * uniform.scale * triangles[selectedTriangle + 1].position) - oldAnimePosition2;
+        Vector4f temp3 = (uniform.view * uniform.translate * uniform.rotate * uniform.scale * triangles[selectedTriangle + 2].position) - oldAnimePosition3;
+        if (key == 'n' || key == 'b') {
+            std::cout << "Animating......";
+            // The triangle goes from its position before the move to the current one, in a straight line or along
+            // a curve pulled sideways. The frames of the animation are drawn as they come.
+            const Vector4f from[3] = { oldAnimePosition1, oldAnimePosition2, oldAnimePosition3 };
+            const Vector4f temp[3] = { temp1, temp2, temp3 };
+            Vector4f control[3], to[3];
+            for (int k = 0; k < 3; k++) {
+                to[k] = from[k] + temp[k];
+                control[k] = key == 'b' ? Vector4f(temp[k].y(), -temp[k].x(), temp[k].z(), temp[k].w()) : Vector4f((from[k] + to[k]) / 2);
+            }
+            uniform.translate << identity;
+            animation.start(selectedTriangle, from, control, to);
+            redrawNext = true;
+
+            animationMode = false;
+            isPositionSet = false;
+            key = 'q';//to exit
+        }
+    }
+
+    if (currentMode == TRANSLATION_MODE) {
+        if (selectedTriangle >= 0) {
+            performTranslationAction(key, triangles, uniform, selectedTriangle);
+            redrawNext = true;
+        }
+    }
+    else if (currentMode == COLOR_MODE) {
+        if (key >= '1' && key <= '9') {
+            if (vertex_index >= 0) {
+                double val = (key - '1') * 0.1;
+                triangles[vertex_index].color = Vector4f(val, val + 0.1, val + 0.2, 1);
+                redrawNext = true;
+            }
+        }
+    }
+    
+    changeViewport(key, zoom, delta, uniform, redrawNext);
+    
+}
+
+void Editor::draw(RenderTarget& target) {
+    const uint64_t allocations = heap_allocation_count();
+    const FrameBufferAttributes background(0, 0, 0, 255);
+    // The statistics are recorded only when someone reads them, the clocks of the pipeline cost nothing otherwise
+    const bool recordStats = statsOverlay || statsRecording;
+    if (recordStats)
+        stats.begin_frame();
+
+    // Move the animated triangle to its position at this frame, and ask for the next frame until it arrives
+    if (animation.running && animation.advance(triangles))
+        redrawNext = true;
+
+    // Draw straight into the target when it keeps its pixels from one frame to the next. The framebuffer
+    // wraps them again when they move, their content is then unknown.
+    uint8_t* targetPixels = nullptr;
+    int targetPitch = 0;
+    const bool inPlace = target.lock_frame(targetPixels, targetPitch);
+    if (inPlace && (targetPixels != frameBuffer.pixels() || targetPitch != frameBuffer.pitch())) {
+        frameBuffer = FrameBuffer(width, height, targetPixels, targetPitch);
+        dirty.invalidate();
+    }
+
+    preview = &noPreview;
+    previewStrip = false;
+    if (currentMode == INSERTION_MODE) {
+        if (numOfClicks == 1) {
+            preview = &lines;
+        }
+        else if (numOfClicks == 2) {
+            VertexAttributes v1 = triangleVertices[0];
+            VertexAttributes v2 = triangleVertices[1];
+            VertexAttributes v3 = lines[lines.size() - 1];
+            outline[0] = v1;
+            outline[1] = v2;
+            outline[2] = v3;
+            outline[3] = v1;
+            preview = &outline;
+            previewStrip = true;
+        }
+        else if (numOfClicks == 3) {
+            numOfClicks = 0;
+            setColor(triangleVertices[0], triangleVertices[1], triangleVertices[2], BLUE);
+            Vector4f bary_center = (triangleVertices[0].position + triangleVertices[1].position + triangleVertices[2].position) / 3;
+            triangleVertices[0].bary_center = bary_center;
+            triangleVertices[1].bary_center = bary_center;
+            triangleVertices[2].bary_center = bary_center;
+            triangles.insert(triangles.end(), triangleVertices.begin(), triangleVertices.end());
+            triangleVertices.clear();
+            lines.clear();
+        }
+    }
+    const bool meshChanged = mesh.update(triangles);
+
+    // Triangle being edited in translation mode
+    const int edited = currentMode == TRANSLATION_MODE && selectedTriangle >= 0 && unsigned(selectedTriangle) + 2 < triangles.size() ? selectedTriangle / 3 : -1;
+
+    // Find what changed on screen. The heatmap counts the fragments of the whole frame, it is drawn whole
+    // as is the first frame after it. A triangle entering or leaving edition, or shifted by an insertion or
+    // deletion, moves between the background and the top of the frame, which is drawn whole as well.
+    // Dragging changes the translate uniform, which moves every triangle, so the background follows the drag.
+    dirty.update(program.VertexShader, uniform, mesh, *preview, previewThickness, frameBuffer.width(), frameBuffer.height());
+    if (heatmapMode || previousInputs.heatmapMode || edited != backgroundEdited || (edited >= 0 && dirty.insertedOrDeleted())) {
+        dirty.invalidate();
+        backgroundLayer.valid = false;
+    }
+    // The statistics graph changes every frame
+    if (statsOverlay)
+        dirty.add(ScreenRect(0, 0, stats.capacity() * STATS_BAR_WIDTH - 1, STATS_GRAPH_HEIGHT - 1));
+
+    // The edited triangle and the preview are drawn over the background layer every frame
+    editedTriangle.clear();
+    if (edited >= 0)
+        for (int k = 0; k < 3; k++)
+            editedTriangle.push_back(mesh.vertices[mesh.indices[3 * edited + k]]);
+    auto drawDynamic = [&]() {
+        rasterize_triangles(program, uniform, editedTriangle, frameBuffer, depthBuffer);
+        if (previewStrip)
+            rasterize_line_strip(program, uniform, *preview, previewThickness, frameBuffer);
+        else
+            rasterize_lines(program, uniform, *preview, previewThickness, frameBuffer);
+    };
+
+    if (heatmapMode) {
+        // The heatmap counts the fragments of every triangle in the frame, the layers are not used
+        frameBuffer.clear_deferred(background);
+        StageClock clock;
+        depthBuffer.setConstant(std::numeric_limits<float>::infinity());
+        overdraw.setConstant(OverdrawCounters());
+        clock.lap(STAGE_CLEAR);
+        if (!mesh.indices.empty())
+            rasterize_indexed_triangles(program, uniform, mesh.vertices, mesh.indices, frameBuffer, depthBuffer);
+        drawDynamic();
+        overdraw_to_heatmap(overdraw, heatmapMode == 2, frameBuffer);
+        backgroundLayer.valid = false;
+
+        frameBuffer.resolve_clear();
+    }
+    else {
+        // Bring the background layer up to date: whole, or within the dirty rectangles when triangles other
+        // than the edited one changed
+        FrameBuffer& layerPixels = backgroundLayer.frameBuffer;
+        DepthBuffer& layerDepth = backgroundLayer.depthBuffer;
+        if (!backgroundLayer.valid || edited != backgroundEdited || (dirty.redrawAll() && !dirty.changedOnly(edited))) {
+            // Clear the layer, only the tiles that get drawn into or were drawn into before are written
+            layerPixels.clear_deferred(background);
+            StageClock clock;
+            layerDepth.setConstant(std::numeric_limits<float>::infinity());
+            clock.lap(STAGE_CLEAR);
+            backgroundIndices.clear();
+            for (unsigned i = 0; i < mesh.indices.size(); i++)
+                if (int(i / 3) != edited)
+                    backgroundIndices.push_back(mesh.indices[i]);
+            if (!backgroundIndices.empty())
+                rasterize_indexed_triangles(program, uniform, mesh.vertices, backgroundIndices, layerPixels, layerDepth);
+            layerPixels.resolve_clear();
+            backgroundLayer.valid = true;
+            backgroundEdited = edited;
+        }
+        else if (!dirty.changedOnly(edited)) {
+            for (unsigned i = 0; i < dirty.rects.size(); i++) {
+                const ScreenRect& rect = dirty.rects[i];
+                layerPixels.set_scissor(rect.lx, rect.ly, rect.ux, rect.uy);
+                layerPixels.clear(background, rect.lx, rect.ly, rect.ux, rect.uy);
+                StageClock clock;
+                layerDepth.block(rect.lx, rect.ly, rect.ux - rect.lx + 1, rect.uy - rect.ly + 1).setConstant(std::numeric_limits<float>::infinity());
+                clock.lap(STAGE_CLEAR);
+                dirtyTriangles.clear();
+                dirty.overlapping(rect, mesh, dirtyTriangles, edited);
+                rasterize_triangles(program, uniform, dirtyTriangles, layerPixels, layerDepth);
+            }
+            layerPixels.reset_scissor();
+        }
+
+        // Compose the frame from the background layer and the edited triangle and preview on top of it
+        if (dirty.redrawAll()) {
+            frameBuffer.copy(layerPixels, 0, 0, width - 1, height - 1);
+            StageClock clock;
+            depthBuffer.setConstant(std::numeric_limits<float>::infinity());
+            clock.lap(STAGE_CLEAR);
+            drawDynamic();
+        }
+        else {
+            for (unsigned i = 0; i < dirty.rects.size(); i++) {
+                const ScreenRect& rect = dirty.rects[i];
+                frameBuffer.set_scissor(rect.lx, rect.ly, rect.ux, rect.uy);
+                frameBuffer.copy(layerPixels, rect.lx, rect.ly, rect.ux, rect.uy);
+                StageClock clock;
+                depthBuffer.block(rect.lx, rect.ly, rect.ux - rect.lx + 1, rect.uy - rect.ly + 1).setConstant(std::numeric_limits<float>::infinity());
+                clock.lap(STAGE_CLEAR);
+                drawDynamic();
+            }
+            frameBuffer.reset_scissor();
+        }
+    }
+
+    if (statsOverlay)
+        drawStatsOverlay();
+
+    // Present the frame, only the dirty rectangles after a partial redraw. The framebuffer pixels are laid out as
+    // the frames of the target, they are presented without conversion.
+    const bool partial = !heatmapMode && !dirty.redrawAll();
+    if (partial)
+        dirty.targetRects(dirtyRects);
+    StageClock presentClock;
+    if (inPlace)
+        target.unlock_frame(partial ? &dirtyRects : nullptr);
+    else
+        target.present_frame(frameBuffer.pixels(), frameBuffer.width(), frameBuffer.height(), frameBuffer.pitch(), partial ? &dirtyRects : nullptr);
+    presentClock.lap(STAGE_PRESENT);
+    dirty.frameDrawn();
+    if (recordStats)
+        stats.end_frame();
+
+    // A steady frame, redrawing the scene of the previous one, must not allocate
+    FrameInputs inputs;
+    inputs.transform = uniform.view * uniform.translate * uniform.rotate * uniform.scale;
+    inputs.mode = uniform.mode;
+    inputs.numOfClicks = numOfClicks;
+    inputs.numOfLines = lines.size();
+    inputs.heatmapMode = heatmapMode;
+    inputs.statsOverlay = statsOverlay;
+    assert(meshChanged || !(inputs == previousInputs) || heap_allocation_count() == allocations);
+    // Only the assertion reads them, release builds compile it out
+    (void)meshChanged;
+    (void)allocations;
+    previousInputs = inputs;
+}
+
+void Editor::drawStatsOverlay() {
+    const int bars = std::min(int(stats.capacity()), width / STATS_BAR_WIDTH);
+    const int top = std::min(STATS_GRAPH_HEIGHT, height) - 1;
+    if (bars <= 0 || top < 0)
+        return;
+
+    // The graph is not part of the frame it measures
+    FrameStats* recording = frame_stats();
+    set_frame_stats(nullptr);
+
+    frameBuffer.clear(STATS_BACKGROUND, 0, 0, bars * STATS_BAR_WIDTH - 1, top);
+    for (int age = 0; age < bars && unsigned(age) < stats.size(); age++) {
+        const FrameStats& frame = stats.frame(age);
+        const int lx = (bars - 1 - age) * STATS_BAR_WIDTH;
+        uint64_t elapsed = 0;
+        int ly = 0;
+        for (int s = 0; s <= STAGE_COUNT; s++) {
+            // The rest of the frame is the time not spent in any stage
+            elapsed = s < STAGE_COUNT ? elapsed + frame.stage_ns[s] : std::max(elapsed, frame.frame_ns);
+            const int uy = int(std::min<uint64_t>(elapsed * STATS_GRAPH_HEIGHT / STATS_GRAPH_NS, top + 1)) - 1;
+            if (uy >= ly)
+                frameBuffer.clear(STATS_COLORS[s], lx, ly, lx + STATS_BAR_WIDTH - 1, uy);
+            ly = std::max(ly, uy + 1);
+        }
+    }
+    if (STATS_GRAPH_HEIGHT / 2 <= top)
+        frameBuffer.clear(STATS_REFERENCE, 0, STATS_GRAPH_HEIGHT / 2, bars * STATS_BAR_WIDTH - 1, STATS_GRAPH_HEIGHT / 2);
+
+    set_frame_stats(recording);
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include "raster.h"
+#include "RenderTarget.h"
+
+/* Duration of the animations, in seconds */
+const static float ANIMATION_SECONDS = 2.5f;
+
+/* Enum to store Editor Mode*/
+enum Mode { INSERTION_MODE, TRANSLATION_MODE, DELETION_MODE, COLOR_MODE };
+
+/* Indexed copy of the triangle store used for drawing. Vertices with the same attributes are welded,
+   so that the vertex shader runs once per unique vertex. */
+class IndexedTriangles {
+public:
+    std::vector<VertexAttributes> vertices;
+    std::vector<unsigned> indices;
+
+    /* Brings the copy up to date with the store: inserted triangles are appended, any other edit rebuilds it.
+       Returns whether the copy changed. */
+    bool update(const std::vector<VertexAttributes>& triangles) {
+        bool valid = indices.size() <= triangles.size();
+        for (unsigned i = 0; valid && i < indices.size(); i++)
+            valid = key(vertices[indices[i]]) == key(triangles[i]);
+        if (!valid) {
+            vertices.clear();
+            indices.clear();
+            lookup.clear();
+        }
+        const bool changed = !valid || indices.size() < triangles.size();
+        for (unsigned i = indices.size(); i < triangles.size(); i++)
+            indices.push_back(weld(triangles[i]));
+        return changed;
+    }
+
+private:
+    // Attributes read by the vertex shader, the barycenter is only used for selected triangles
+    typedef std::array<float, 13> Key;
+    std::map<Key, unsigned> lookup;
+
+    static Key key(const VertexAttributes& v) {
+        Key k;
+        for (int c = 0; c < 4; c++) {
+            k[c] = v.position[c];
+            k[4 + c] = v.color[c];
+            k[8 + c] = v.selected ? v.bary_center[c] : 0;
+        }
+        k[12] = v.selected;
+        return k;
+    }
+
+    unsigned weld(const VertexAttributes& v) {
+        std::map<Key, unsigned>::iterator found = lookup.find(key(v));
+        if (found != lookup.end())
+            return found->second;
+        vertices.push_back(v);
+        lookup[key(v)] = vertices.size() - 1;
+        return vertices.size() - 1;
+    }
+};
+
+/* Inputs of a frame besides the triangles. A frame with the same inputs as the previous one and an unchanged
+   mesh draws the same image, it must reuse the memory of the previous frame instead of allocating. */
+class FrameInputs {
+public:
+    Eigen::Matrix4f transform;
+    char mode;
+    unsigned numOfClicks;
+    size_t numOfLines;
+    int heatmapMode;
+    bool statsOverlay;
+
+    FrameInputs() : transform(Eigen::Matrix4f::Zero()), mode(0), numOfClicks(0), numOfLines(0), heatmapMode(0), statsOverlay(false) {}
+
+    bool operator==(const FrameInputs& other) const {
+        return transform == other.transform && mode == other.mode && numOfClicks == other.numOfClicks
+            && numOfLines == other.numOfLines && heatmapMode == other.heatmapMode && statsOverlay == other.statsOverlay;
+    }
+};
+
+/* Rectangle of framebuffer pixels, bounds included, y going up as in the framebuffer */
+class ScreenRect {
+public:
+    int lx, ly, ux, uy;
+
+    ScreenRect() : lx(0), ly(0), ux(-1), uy(-1) {}
+    ScreenRect(int lx, int ly, int ux, int uy) : lx(lx), ly(ly), ux(ux), uy(uy) {}
+
+    bool empty() const { return lx > ux || ly > uy; }
+    int area() const { return empty() ? 0 : (ux - lx + 1) * (uy - ly + 1); }
+
+    bool overlaps(const ScreenRect& other) const {
+        return !empty() && !other.empty() && lx <= other.ux && other.lx <= ux && ly <= other.uy && other.ly <= uy;
+    }
+
+    void extend(const ScreenRect& other) {
+        if (other.empty())
+            return;
+        if (empty()) {
+            *this = other;
+            return;
+        }
+        lx = std::min(lx, other.lx);
+        ly = std::min(ly, other.ly);
+        ux = std::max(ux, other.ux);
+        uy = std::max(uy, other.uy);
+    }
+};
+
+/* Tracks the pixels that changed since the last frame. Every frame, the triangles and the preview lines are
+   compared with the ones drawn in the previous frame after the vertex shader: the old and the new bounds of
+   the ones that moved, changed color, appeared or disappeared are dirty. Only the triangles overlapping the
+   dirty rectangles need to be drawn again. */
+class DirtyRegion {
+public:
+    // Disjoint dirty rectangles of the frame
+    std::vector<ScreenRect> rects;
+
+    DirtyRegion() : full(true), width(0), height(0), changedFirst(1), changedLast(0), resized(false) {
+        // Frames differing in their number of rectangles do not allocate
+        rects.reserve(MAX_RECTS + 1);
+    }
+
+    // Makes the next frame a full redraw, for the changes that are not made to the triangles
+    void invalidate() { full = true; }
+
+    // Whether the frame must be drawn whole instead of the dirty rectangles
+    bool redrawAll() const { return full; }
+
+    // Whether triangles were inserted or deleted since the last frame
+    bool insertedOrDeleted() const { return resized; }
+
+    // Whether triangle t is the only one that changed since the last frame, if any did
+    bool changedOnly(int t) const {
+        return !resized && (changedFirst > changedLast || (changedFirst == t && changedLast == t));
+    }
+
+    /* Compares the indexed triangles and the preview vertices, drawn as lines of the given thickness, with
+       the ones of the previous frame and collects the rectangles that changed */
+    template <typename VS>
+    void update(const VS& vertexShader, const UniformAttributes& uniform, const IndexedTriangles& mesh,
+                const std::vector<VertexAttributes>& preview, float line_thickness, int frameWidth, int frameHeight) {
+        if (frameWidth != width || frameHeight != height) {
+            width = frameWidth;
+            height = frameHeight;
+            full = true;
+        }
+        rects.clear();
+
+        // Footprint of every triangle after the vertex shader
+        shaded.resize(mesh.vertices.size());
+        for (unsigned i = 0; i < mesh.vertices.size(); i++)
+            shaded[i] = vertexShader(mesh.vertices[i], uniform);
+        current.resize(mesh.indices.size() / 3);
+        for (unsigned t = 0; t < current.size(); t++) {
+            const VertexAttributes* v[3] = { &shaded[mesh.indices[3 * t]], &shaded[mesh.indices[3 * t + 1]], &shaded[mesh.indices[3 * t + 2]] };
+            for (int k = 0; k < 3; k++) {
+                for (int c = 0; c < 4; c++) {
+                    current[t].key[8 * k + c] = v[k]->position[c];
+                    current[t].key[8 * k + 4 + c] = v[k]->color[c];
+                }
+            }
+            current[t].bounds = ScreenRect();
+            for (int k = 0; k < 3; k++)
+                current[t].bounds.extend(pixelBounds(v[k]->position, 1));
+        }
+
+        // Triangles are compared in place when none were inserted or deleted. Otherwise the triangles
+        // between the common first and last ones changed.
+        changedFirst = int(current.size());
+        changedLast = -1;
+        resized = current.size() != drawn.size();
+        if (!resized) {
+            for (unsigned t = 0; t < current.size(); t++) {
+                if (current[t].key != drawn[t].key) {
+                    add(drawn[t].bounds);
+                    add(current[t].bounds);
+                    changedFirst = std::min(changedFirst, int(t));
+                    changedLast = t;
+                }
+            }
+        }
+        else {
+            const size_t common = std::min(current.size(), drawn.size());
+            size_t first = 0, last = 0;
+            while (first < common && current[first].key == drawn[first].key)
+                first++;
+            while (first + last < common && current[current.size() - 1 - last].key == drawn[drawn.size() - 1 - last].key)
+                last++;
+            for (size_t t = first; t + last < drawn.size(); t++)
+                add(drawn[t].bounds);
+            for (size_t t = first; t + last < current.size(); t++)
+                add(current[t].bounds);
+        }
+        std::swap(current, drawn);
+        // The buffers take turns, both must hold a frame so that the next one with the same content does not allocate
+        current.reserve(drawn.size());
+
+        // Preview lines, dirty as a whole when any of their vertices changed
+        currentPreview.resize(preview.size() * 4);
+        ScreenRect previewBounds;
+        for (unsigned i = 0; i < preview.size(); i++) {
+            const Eigen::Vector4f position = vertexShader(preview[i], uniform).position;
+            for (int c = 0; c < 4; c++)
+                currentPreview[4 * i + c] = position[c];
+            previewBounds.extend(pixelBounds(position, int(std::ceil(line_thickness)) + 1));
+        }
+        if (currentPreview != drawnPreview) {
+            add(drawnPreviewBounds);
+            add(previewBounds);
+        }
+        std::swap(currentPreview, drawnPreview);
+        currentPreview.reserve(drawnPreview.size());
+        drawnPreviewBounds = previewBounds;
+
+        // Past half of the screen, drawing the dirty rectangles is not cheaper than the whole frame
+        int area = 0;
+        for (unsigned i = 0; i < rects.size(); i++)
+            area += rects[i].area();
+        if (area * 2 > width * height)
+            full = true;
+    }
+
+    /* Appends the triangles of the mesh overlapping rect, but triangle skip, to vertices, three vertices per triangle
+       in submission order */
+    void overlapping(const ScreenRect& rect, const IndexedTriangles& mesh, std::vector<VertexAttributes>& vertices, int skip = -1) const {
+        for (unsigned t = 0; t < drawn.size(); t++)
+            if (int(t) != skip && drawn[t].bounds.overlaps(rect))
+                for (int k = 0; k < 3; k++)
+                    vertices.push_back(mesh.vertices[mesh.indices[3 * t + k]]);
+    }
+
+    /* Adds a rectangle to the dirty ones, merging the rectangles it overlaps */
+    void add(ScreenRect rect) {
+        rect.lx = std::max(rect.lx, 0);
+        rect.ly = std::max(rect.ly, 0);
+        rect.ux = std::min(rect.ux, width - 1);
+        rect.uy = std::min(rect.uy, height - 1);
+        if (rect.empty())
+            return;
+        for (unsigned i = 0; i < rects.size();) {
+            if (rects[i].overlaps(rect)) {
+                rect.extend(rects[i]);
+                rects[i] = rects.back();
+                rects.pop_back();
+                i = 0;
+            }
+            else
+                i++;
+        }
+        rects.push_back(rect);
+        if (rects.size() > MAX_RECTS) {
+            for (unsigned i = 0; i + 1 < rects.size(); i++)
+                rect.extend(rects[i]);
+            rects.assign(1, rect);
+        }
+    }
+
+    /* Rectangles in render target coordinates, y going down */
+    void targetRects(std::vector<TargetRect>& targetRects) const {
+        targetRects.clear();
+        for (unsigned i = 0; i < rects.size(); i++)
+            targetRects.push_back(TargetRect(rects[i].lx, height - 1 - rects[i].uy, rects[i].ux - rects[i].lx + 1, rects[i].uy - rects[i].ly + 1));
+    }
+
+    // Called once the frame is drawn
+    void frameDrawn() { full = false; }
+
+private:
+    /* Triangle of the previous frame, its vertices after the vertex shader and the pixels it may cover */
+    class DrawnTriangle {
+    public:
+        std::array<float, 24> key;
+        ScreenRect bounds;
+    };
+
+    // Above this many rectangles, they are merged into one
+    static const unsigned MAX_RECTS = 8;
+
+    bool full;
+    int width, height;
+    // Range of the triangles that changed in the last update, and whether triangles were inserted or deleted
+    int changedFirst, changedLast;
+    bool resized;
+    std::vector<VertexAttributes> shaded;
+    std::vector<DrawnTriangle> drawn, current;
+    std::vector<float> drawnPreview, currentPreview;
+    ScreenRect drawnPreviewBounds;
+
+    /* Pixels within margin of a vertex after the vertex shader, the whole screen if it is behind the eye */
+    ScreenRect pixelBounds(const Eigen::Vector4f& position, int margin) const {
+        if (!(position[3] > 0) || !std::isfinite(position[0] / position[3]) || !std::isfinite(position[1] / position[3]))
+            return ScreenRect(0, 0, width - 1, height - 1);
+        const float x = std::max(-1.0f, std::min(2.0f, position[0] / position[3] * 0.5f + 0.5f)) * width;
+        const float y = std::max(-1.0f, std::min(2.0f, position[1] / position[3] * 0.5f + 0.5f)) * height;
+        return ScreenRect(int(std::floor(x)) - margin, int(std::floor(y)) - margin, int(std::ceil(x)) + margin, int(std::ceil(y)) + margin);
+    }
+};
+
+/* Animation of a triangle along a quadratic Bezier curve, a straight line when the control points are halfway.
+   Every frame drawn while it runs moves the triangle to its position at that time. */
+class TriangleAnimation {
+public:
+    bool running;
+
+    TriangleAnimation() : running(false), triangle(0) {}
+
+    /* Starts moving the triangle whose vertices start at index first, from the positions from to the positions to */
+    void start(int first, const Eigen::Vector4f from[3], const Eigen::Vector4f control[3], const Eigen::Vector4f to[3]) {
+        triangle = first;
+        for (int k = 0; k < 3; k++) {
+            points[k][0] = from[k];
+            points[k][1] = control[k];
+            points[k][2] = to[k];
+        }
+        startTime = std::chrono::steady_clock::now();
+        running = true;
+    }
+
+    /* Moves the triangle to its position at the current time, returns whether the animation goes on */
+    bool advance(std::vector<VertexAttributes>& triangles) {
+        if (triangle < 0 || unsigned(triangle) + 2 >= triangles.size()) {
+            running = false;
+            return false;
+        }
+        const float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+        const float t = std::min(elapsed / ANIMATION_SECONDS, 1.0f);
+        const float t_one = 1 - t;
+        for (int k = 0; k < 3; k++)
+            triangles[triangle + k].position = t_one * t_one * points[k][0] + 2 * t * t_one * points[k][1] + t * t * points[k][2];
+        running = t < 1;
+        return running;
+    }
+
+private:
+    int triangle;
+    Eigen::Vector4f points[3][3];
+    std::chrono::steady_clock::time_point startTime;
+};
+
+/* Vertex shader of the editor, it applies the view and the transformations of the uniform. Selected triangles are
+   scaled and rotated about their barycenter. */
+class EditorVertexShader {
+public:
+    VertexAttributes operator()(const VertexAttributes& va, const UniformAttributes& uniform) const;
+};
+
+/* Span fragment shader of the editor, it outputs the interpolated color of a whole span, alpha included */
+class EditorFragmentShader {
+public:
+    void operator()(const FragmentSpan& span, const UniformAttributes& uniform, FragmentAttributes* fragments) const;
+};
+
+typedef ShaderProgram<EditorVertexShader, NoShader, NoShader, EditorFragmentShader, SpanBlender> EditorProgram;
+
+/* Method to get index of selected triangle based on clicked position */
+int getSelectedTriangleIndex(std::vector<VertexAttributes>& triangles, UniformAttributes& uniform, double x_pos, double y_pos);
+
+/* The scene of the editor and its editing state. The input is fed by the owner, a window or a headless program,
+   and frames are drawn into any render target. */
+class Editor {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    /* Editor drawing frames of width x height pixels */
+    Editor(int width, int height);
+
+    /* Input events, positions are in pixels from the top left corner of the frame */
+    void mouseMove(int x, int y);
+    void mousePressed(int x, int y, bool mouseButtonUp);
+    void keyPressed(char key);
+
+    /* Draws a frame of the scene into the target */
+    void draw(RenderTarget& target);
+
+    /* Triangles of the scene, three vertices each */
+    const std::vector<VertexAttributes>& getTriangles() const { return triangles; }
+
+    /* Replaces the triangles of the scene, three vertices each, and leaves the edition in progress */
+    void setTriangles(const std::vector<VertexAttributes>& scene);
+
+    /* Time of the stages and counters of the pipeline for the last frames recorded, the most recent first */
+    const FrameStatsHistory& getStats() const { return stats; }
+
+    /* Records the statistics of the frames drawn from now on, until it is called with false. They are
+       recorded anyway while their graph is shown. */
+    void setStatsRecording(bool record) { statsRecording = record; }
+
+    /* Set when the scene changed and a frame should be drawn, the owner resets it */
+    bool redrawNext;
+
+private:
+    int width;
+    int height;
+
+    // The Framebuffer storing the image rendered by the rasterizer
+    FrameBuffer frameBuffer;
+
+    // Depth of the triangles, so that the pixels hidden by later triangles are not shaded
+    DepthBuffer depthBuffer;
+
+    // Overdraw diagnostic, cycled with the heatmap key: 0 shows the scene, 1 the shaded fragments, 2 the tested fragments
+    OverdrawBuffer overdraw;
+    int heatmapMode;
+
+    UniformAttributes uniform;
+
+    // Span rasterization program, the rasterizer is compiled for these shaders and inlines them
+    EditorProgram program;
+
+    Mode currentMode;
+
+    // No. of triangles
+    unsigned numOfClicks;
+
+    //Translation mode
+    int selectedTriangle, prevClickedTriangle;
+    Eigen::Vector4f oldPosition, newPosition;
+    bool isClicked;
+    bool isCursorMoving, firstTime;
+
+    //Color Mode
+    int vertex_index;
+    float zoom;
+    float delta;
+
+    //Animation Mode
+    bool animationMode, isPositionSet;
+    Eigen::Vector4f oldAnimePosition1, oldAnimePosition2, oldAnimePosition3;
+    TriangleAnimation animation;
+
+    //vector to store complete triangles
+    std::vector<VertexAttributes> triangles;
+
+    //indexed copy of the triangles for drawing
+    IndexedTriangles mesh;
+
+    //vector to store triangle vertices which are being built in progress
+    std::vector<VertexAttributes> lines;
+
+    //vector to store triangle vertices
+    std::vector<VertexAttributes> triangleVertices;
+
+    // Outline of the triangle being inserted, kept across frames so that redrawing does not allocate
+    std::vector<VertexAttributes> outline;
+
+    // Lines previewing the triangle being inserted, drawn as pairs of vertices or as a strip
+    const std::vector<VertexAttributes> noPreview;
+    const std::vector<VertexAttributes>* preview;
+    bool previewStrip;
+    const float previewThickness;
+
+    // Parts of the screen changed since the last frame, the triangles overlapping them and their target rectangles
+    DirtyRegion dirty;
+    std::vector<VertexAttributes> dirtyTriangles;
+    std::vector<TargetRect> dirtyRects;
+
+    // Every triangle but the one being edited, kept while they do not change. The edited triangle is drawn over it.
+    RasterLayer backgroundLayer;
+    int backgroundEdited;
+    std::vector<unsigned> backgroundIndices;
+    std::vector<VertexAttributes> editedTriangle;
+
+    // Inputs of the previous frame, for the allocation check of debug builds
+    FrameInputs previousInputs;
+
+    // Pipeline statistics of the last frames recorded, whether their graph is drawn over the frame and
+    // whether the owner asked for them
+    FrameStatsHistory stats;
+    bool statsOverlay;
+    bool statsRecording;
+
+    /* Draws the time of the last frames as stacked bars, one color per stage, at the bottom left of the frame */
+    void drawStatsOverlay();
+};
@@ -0,0 +1,78 @@
+#include "Editor.h"
+#include "RenderTarget.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Image writing library
+#define STB_IMAGE_WRITE_IMPLEMENTATION // Do not include this line twice in your project!
+#include "stb_image_write.h"
+
+// Runs the editor without a window or a display server, drawing its frames in memory. The input is read from the
+// standard input as commands separated by whitespace, positions are in pixels from the top left corner:
+//   move x y       mouse motion
+//   press x y      mouse button pressed
+//   release x y    mouse button released
+//   key c          key c pressed
+//   draw           draws a frame
+//   save file      saves the last frame as a png, drawing a frame first if the scene changed since
+int main(int argc, char *args[])
+{
+    const int width = argc > 2 ? std::atoi(args[1]) : 500;
+    const int height = argc > 2 ? std::atoi(args[2]) : 500;
+    if (width <= 0 || height <= 0)
+    {
+        std::cerr << "usage: " << args[0] << " [width height] < commands" << std::endl;
+        return 1;
+    }
+
+    Editor editor(width, height);
+    OffscreenTarget target(width, height);
+
+    auto drawFrame = [&]() {
+        editor.redrawNext = false;
+        editor.draw(target);
+    };
+
+    std::string command;
+    while (std::cin >> command)
+    {
+        int x = 0, y = 0;
+        char key = 0;
+        std::string path;
+        if (command == "move" || command == "press" || command == "release")
+        {
+            if (!(std::cin >> x >> y))
+            {
+                std::cerr << "expected a position after " << command << std::endl;
+                return 1;
+            }
+            if (command == "move")
+                editor.mouseMove(x, y);
+            else
+                editor.mousePressed(x, y, command == "release");
+        }
+        else if (command == "key" && std::cin >> key)
+            editor.keyPressed(key);
+        else if (command == "draw")
+            drawFrame();
+        else if (command == "save" && std::cin >> path)
+        {
+            if (editor.redrawNext || target.frames_presented() == 0)
+                drawFrame();
+            if (!stbi_write_png(path.c_str(), target.width(), target.height(), 4, target.pixels(), target.pitch()))
+            {
+                std::cerr << "could not write " << path << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "invalid command: " << command << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
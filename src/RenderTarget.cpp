@@ -0,0 +1,38 @@
+#include "RenderTarget.h"
+
+#include <algorithm>
+#include <cstring>
+
+OffscreenTarget::OffscreenTarget(const int w, const int h)
+    : image_width(w), image_height(h), image(size_t(4) * w * h, 0), frame_count(0)
+{
+}
+
+bool OffscreenTarget::lock_frame(uint8_t *&pixels, int &pitch)
+{
+    pixels = image.data();
+    pitch = 4 * image_width;
+    return true;
+}
+
+void OffscreenTarget::unlock_frame(const std::vector<TargetRect> *)
+{
+    frame_count++;
+}
+
+void OffscreenTarget::present_frame(const uint8_t *pixels, const int w, const int h, const int pitch, const std::vector<TargetRect> *rects)
+{
+    // Copy the rectangles, or the whole frame, clipped to the target
+    const TargetRect whole(0, 0, w, h);
+    const size_t count = rects != nullptr ? rects->size() : 1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const TargetRect &rect = rects != nullptr ? (*rects)[i] : whole;
+        const int x0 = std::max(rect.x, 0), y0 = std::max(rect.y, 0);
+        const int x1 = std::min(std::min(rect.x + rect.w, w), image_width);
+        const int y1 = std::min(std::min(rect.y + rect.h, h), image_height);
+        for (int y = y0; y < y1; ++y)
+            std::memcpy(&image[(size_t(y) * image_width + x0) * 4], pixels + size_t(y) * pitch + size_t(x0) * 4, size_t(std::max(x1 - x0, 0)) * 4);
+    }
+    frame_count++;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Rectangle of the pixels of a render target, from its top left corner with y going down
+class TargetRect
+{
+public:
+    int x, y, w, h;
+
+    TargetRect() : x(0), y(0), w(0), h(0) {}
+    TargetRect(const int x, const int y, const int w, const int h) : x(x), y(y), w(w), h(h) {}
+};
+
+// Destination of the frames drawn by the editor: a window, or memory when there is no display. Frames are rows
+// of rgba8 pixels from the top of the image, pitch bytes apart, the layout of a FrameBuffer.
+class RenderTarget
+{
+public:
+    virtual ~RenderTarget() {}
+
+    // Locks the pixels of the target so that a frame can be drawn into them in place. Returns false if the target
+    // cannot be drawn into in place, or if its pixels do not keep the frame presented last.
+    virtual bool lock_frame(uint8_t *&pixels, int &pitch) = 0;
+
+    // Presents the frame drawn since lock_frame(), only the rectangles when rects is not null. The rest of the
+    // target keeps the frame presented before.
+    virtual void unlock_frame(const std::vector<TargetRect> *rects) = 0;
+
+    // Presents a frame of w x h pixels drawn elsewhere, only the rectangles when rects is not null
+    virtual void present_frame(const uint8_t *pixels, const int w, const int h, const int pitch, const std::vector<TargetRect> *rects) = 0;
+};
+
+// Render target in memory, for drawing without a window or a display server. Frames are drawn into its pixels in
+// place, which keep the last frame until the next one.
+class OffscreenTarget : public RenderTarget
+{
+public:
+    OffscreenTarget(const int w, const int h);
+
+    bool lock_frame(uint8_t *&pixels, int &pitch) override;
+    void unlock_frame(const std::vector<TargetRect> *rects) override;
+    void present_frame(const uint8_t *pixels, const int w, const int h, const int pitch, const std::vector<TargetRect> *rects) override;
+
+    int width() const { return image_width; }
+    int height() const { return image_height; }
+
+    // The last frame presented, rows of rgba8 pixels from the top of the image, pitch() bytes apart
+    const uint8_t *pixels() const { return image.data(); }
+    int pitch() const { return 4 * image_width; }
+
+    // Frames presented since the target was created
+    unsigned frames_presented() const { return frame_count; }
+
+private:
+    int image_width, image_height;
+    std::vector<uint8_t> image;
+    unsigned frame_count;
+};
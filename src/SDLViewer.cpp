@@ -1,30 +1,12 @@
 #include "SDLViewer.h"
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 
-namespace
-{
-    Uint32 redraw_callback(Uint32 interval, void *param)
-    {
-        SDL_Event event;
-        SDL_UserEvent userevent;
-
-        userevent.type = SDL_USEREVENT;
-        userevent.code = 0;
-        userevent.data1 = NULL;
-        userevent.data2 = NULL;
-
-        event.type = SDL_USEREVENT;
-        event.user = userevent;
-
-        SDL_PushEvent(&event);
-        return (interval);
-    }
-} // namespace
-
 SDLViewer::SDLViewer()
-    : window(nullptr), window_surface(nullptr), redraw_next(false)
+    : redraw_next(false), window(nullptr), window_surface(nullptr), renderer(nullptr), texture(nullptr),
+      texture_width(0), texture_height(0), frame_count(0), missed_count(0), image_surface(nullptr)
 {
 }
 
@@ -34,7 +16,10 @@ void SDLViewer::resize(const int w, const int h)
         return;
 
     SDL_SetWindowSize(window, w, h);
-    window_surface = SDL_GetWindowSurface(window);
+    if (renderer != nullptr)
+        size_texture(w, h);
+    else
+        window_surface = SDL_GetWindowSurface(window);
     update();
 }
 
@@ -48,7 +33,7 @@ void SDLViewer::update()
         redraw(*this);
 }
 
-bool SDLViewer::init(const std::string &window_name, const int w, const int h)
+bool SDLViewer::init(const std::string &window_name, const int w, const int h, const bool vsync)
 {
     //Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) < 0)
@@ -70,20 +55,61 @@ bool SDLViewer::init(const std::string &window_name, const int w, const int h)
             return false;
         }
 
+        // Frames are drawn straight into the window surface when its pixels are rgba8. Otherwise, as with the
+        // xrgb8888 surfaces of most desktops, they go through a streaming texture in that format, which the renderer
+        // converts when presenting. The frames are then drawn in memory and only their dirty rectangles are copied
+        // to the texture: its locked pixels do not keep the last frame, drawing into them would redraw it whole.
+        if (SDL_GetWindowPixelFormat(window) != SDL_PIXELFORMAT_RGBA32)
+        {
+            renderer = SDL_CreateRenderer(window, -1, vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+            if (renderer != nullptr && !size_texture(w, h))
+            {
+                SDL_DestroyRenderer(renderer);
+                renderer = nullptr;
+            }
+        }
+
         //Get window surface
-        window_surface = SDL_GetWindowSurface(window);
+        if (renderer == nullptr)
+            window_surface = SDL_GetWindowSurface(window);
     }
 
     return true;
 }
 
+bool SDLViewer::size_texture(const int w, const int h)
+{
+    if (texture != nullptr && texture_width == w && texture_height == h)
+        return true;
+
+    if (texture != nullptr)
+        SDL_DestroyTexture(texture);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, w, h);
+    if (texture == nullptr)
+    {
+        std::cout << "Unable to create texture SDL Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    texture_width = w;
+    texture_height = h;
+    return true;
+}
+
+void SDLViewer::present_texture()
+{
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
 bool SDLViewer::draw_image(
     const Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic> &R,
     const Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic> &G,
     const Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic> &B,
     const Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic> &A)
 {
-    std::vector<uint8_t> data(R.size() * 4);
+    // Interleave the channels, the buffer is kept from one frame to the next
+    image_data.resize(R.size() * 4);
+    uint8_t *data = image_data.data();
     for (int i = 0; i < R.size(); ++i)
     {
         data[4 * i + 0] = R(i);
@@ -93,87 +119,331 @@ bool SDLViewer::draw_image(
     }
 
     // 4 bytes per pixel * pixels per row
+    return draw_image(data, R.rows(), R.cols(), 4 * R.rows());
+}
+
+bool SDLViewer::draw_image(const uint8_t *pixels, const int w, const int h, const int pitch)
+{
+    if (renderer != nullptr)
+    {
+        if (!size_texture(w, h))
+            return false;
+        SDL_UpdateTexture(texture, NULL, pixels, pitch);
+        present_texture();
+        return true;
+    }
+
+    if (!wrap_image(pixels, w, h, pitch))
+        return false;
+
+    SDL_BlitSurface(image_surface, NULL, window_surface, NULL);
+    SDL_UpdateWindowSurface(window);
+
+    return true;
+}
+
+bool SDLViewer::draw_image(const uint8_t *pixels, const int w, const int h, const int pitch, const std::vector<SDL_Rect> &rects)
+{
+    if (rects.empty())
+        return true;
+
+    // The texture is presented whole, but only the rectangles are uploaded
+    if (renderer != nullptr)
+    {
+        if (!size_texture(w, h))
+            return false;
+        for (size_t i = 0; i < rects.size(); ++i)
+            SDL_UpdateTexture(texture, &rects[i], pixels + rects[i].y * pitch + 4 * rects[i].x, pitch);
+        present_texture();
+        return true;
+    }
+
+    if (!wrap_image(pixels, w, h, pitch))
+        return false;
+
+    // Only the rectangles are copied to the window surface and sent to the screen
+    for (size_t i = 0; i < rects.size(); ++i)
+    {
+        SDL_Rect source = rects[i];
+        SDL_Rect destination = rects[i];
+        SDL_BlitSurface(image_surface, &source, window_surface, &destination);
+    }
+    SDL_UpdateWindowSurfaceRects(window, rects.data(), int(rects.size()));
+
+    return true;
+}
+
+bool SDLViewer::wrap_image(const uint8_t *pixels, const int w, const int h, const int pitch)
+{
     const int depth = 32;
-    const int pitch = 4 * R.rows();
 
     static const Uint32 rmask = 0x000000ff;
     static const Uint32 gmask = 0x0000ff00;
     static const Uint32 bmask = 0x00ff0000;
     static const Uint32 amask = 0xff000000;
 
+    // The surface wrapping the pixels is kept from one frame to the next, and only recreated
+    // when the pixels move or change size
+    if (image_surface != nullptr && (image_surface->pixels != pixels || image_surface->w != w || image_surface->h != h || image_surface->pitch != pitch))
+    {
+        SDL_FreeSurface(image_surface);
+        image_surface = nullptr;
+    }
+
     //The image we will load and show on the screen
-    SDL_Surface *surface;
-    surface = SDL_CreateRGBSurfaceFrom((void *)&data[0], R.rows(), R.cols(),
-                                       depth, pitch,
-                                       rmask, gmask, bmask, amask);
-    if (surface == nullptr)
+    if (image_surface == nullptr)
     {
-        std::cout << "Unable to load image SDL Error: " << SDL_GetError() << std::endl;
-        return false;
+        image_surface = SDL_CreateRGBSurfaceFrom((void *)pixels, w, h,
+                                                 depth, pitch,
+                                                 rmask, gmask, bmask, amask);
+        if (image_surface == nullptr)
+        {
+            std::cout << "Unable to load image SDL Error: " << SDL_GetError() << std::endl;
+            return false;
+        }
+        SDL_SetSurfaceBlendMode(image_surface,SDL_BLENDMODE_NONE);
     }
 
-    SDL_SetSurfaceBlendMode(surface,SDL_BLENDMODE_NONE);
-    SDL_BlitSurface(surface, NULL, window_surface, NULL);
-    SDL_UpdateWindowSurface(window);
-    SDL_FreeSurface(surface);
+    return true;
+}
 
+bool SDLViewer::lock_image(uint8_t *&pixels, int &pitch)
+{
+    if (renderer != nullptr)
+    {
+        void *texture_pixels = nullptr;
+        if (SDL_LockTexture(texture, NULL, &texture_pixels, &pitch) < 0)
+            return false;
+        pixels = static_cast<uint8_t *>(texture_pixels);
+        return true;
+    }
+
+    // The surface of the window is recreated when the window is resized
+    window_surface = SDL_GetWindowSurface(window);
+    if (window_surface == nullptr || window_surface->format->format != SDL_PIXELFORMAT_RGBA32)
+        return false;
+    if (SDL_MUSTLOCK(window_surface) && SDL_LockSurface(window_surface) < 0)
+        return false;
+    pixels = static_cast<uint8_t *>(window_surface->pixels);
+    pitch = window_surface->pitch;
     return true;
 }
 
-void SDLViewer::launch(const int redraw_interval)
+bool SDLViewer::image_kept() const
+{
+    return renderer == nullptr;
+}
+
+bool SDLViewer::unlock_image()
+{
+    if (renderer != nullptr)
+    {
+        SDL_UnlockTexture(texture);
+        present_texture();
+        return true;
+    }
+
+    if (SDL_MUSTLOCK(window_surface))
+        SDL_UnlockSurface(window_surface);
+    return SDL_UpdateWindowSurface(window) == 0;
+}
+
+bool SDLViewer::unlock_image(const std::vector<SDL_Rect> &rects)
+{
+    if (renderer != nullptr)
+        return unlock_image();
+
+    if (SDL_MUSTLOCK(window_surface))
+        SDL_UnlockSurface(window_surface);
+    return rects.empty() || SDL_UpdateWindowSurfaceRects(window, rects.data(), int(rects.size())) == 0;
+}
+
+bool SDLViewer::lock_frame(uint8_t *&pixels, int &pitch)
+{
+    return image_kept() && lock_image(pixels, pitch);
+}
+
+void SDLViewer::unlock_frame(const std::vector<TargetRect> *rects)
 {
+    if (rects != nullptr)
+        unlock_image(window_rects(*rects));
+    else
+        unlock_image();
+}
+
+void SDLViewer::present_frame(const uint8_t *pixels, const int w, const int h, const int pitch, const std::vector<TargetRect> *rects)
+{
+    if (rects != nullptr)
+        draw_image(pixels, w, h, pitch, window_rects(*rects));
+    else
+        draw_image(pixels, w, h, pitch);
+}
+
+const std::vector<SDL_Rect> &SDLViewer::window_rects(const std::vector<TargetRect> &rects)
+{
+    frame_rects.resize(rects.size());
+    for (size_t i = 0; i < rects.size(); ++i)
+    {
+        frame_rects[i].x = rects[i].x;
+        frame_rects[i].y = rects[i].y;
+        frame_rects[i].w = rects[i].w;
+        frame_rects[i].h = rects[i].h;
+    }
+    return frame_rects;
+}
+
+void SDLViewer::launch(const int frame_rate)
+{
+    // Interval between frames in performance counter ticks, the refresh period of the display by default
+    int rate = frame_rate;
+    SDL_DisplayMode mode;
+    if (rate <= 0 && SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0)
+        rate = mode.refresh_rate;
+    if (rate <= 0)
+        rate = 60;
+    const Uint64 frequency = SDL_GetPerformanceFrequency();
+    const Uint64 interval = frequency / rate;
+
     redraw(*this);
-    bool is_quit = false;
+    frame_count++;
 
-    Uint32 delay = (33 / 10) * redraw_interval;
-    SDL_TimerID my_timer_id = SDL_AddTimer(delay, redraw_callback, nullptr);
+    // Earliest start of the next frame, and when the pending redraw was requested
+    Uint64 next_frame = SDL_GetPerformanceCounter() + interval;
+    Uint64 requested = 0;
+    bool pending = false;
 
+    bool is_quit = false;
     SDL_Event event;
     while (!is_quit)
     {
-        if (SDL_WaitEvent(&event))
+        // Sleep until the next event, or until the next frame is due when a redraw is pending
+        bool has_event;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (!redraw_next)
+            has_event = SDL_WaitEvent(&event) != 0;
+        else if (now < next_frame)
+            has_event = SDL_WaitEventTimeout(&event, int(((next_frame - now) * 1000 + frequency - 1) / frequency)) != 0;
+        else
+            has_event = SDL_PollEvent(&event) != 0;
+
+        // Handle every queued event before drawing, so that their redraws are merged into one frame. The mouse
+        // motions between two other events only need the last position.
+        input_events.clear();
+        while (has_event)
         {
-            switch (event.type)
-            {
-            case SDL_QUIT:
+            if (event.type == SDL_QUIT)
                 is_quit = true;
-                break;
-            case SDL_MOUSEMOTION:
-                if (mouse_move != nullptr)
-                    mouse_move(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
-                break;
-
-            case SDL_KEYDOWN:
-            //case SDL_KEYUP:
-                if (key_pressed != nullptr)
-                    key_pressed(event.key.keysym.sym, event.key.state == SDL_PRESSED, event.key.keysym.mod, event.key.repeat);
-                break;
-
-            case SDL_MOUSEBUTTONDOWN:
-                if (mouse_pressed != nullptr)
-                    mouse_pressed(event.button.x, event.button.y, event.button.state == SDL_PRESSED, event.button.button, event.button.clicks, false);
-                break;
-
-            case SDL_MOUSEBUTTONUP:
-                if (mouse_pressed != nullptr)
-                    mouse_pressed(event.button.x, event.button.y, event.button.state == SDL_PRESSED, event.button.button, event.button.clicks, true);
-                break;
-
-            case SDL_MOUSEWHEEL:
-                if (mouse_wheel != nullptr)
-                    mouse_wheel(event.wheel.x, event.wheel.y, event.wheel.direction == SDL_MOUSEWHEEL_NORMAL);
-                break;
-
-            case SDL_USEREVENT:
-                update();
-                break;
-            }
+            else
+                queue_event(event);
+            has_event = SDL_PollEvent(&event) != 0;
+        }
+        if (input_batch != nullptr)
+        {
+            if (!input_events.empty())
+                input_batch(input_events);
+        }
+        else
+        {
+            for (size_t i = 0; i < input_events.size(); ++i)
+                handle_event(input_events[i]);
+        }
+
+        now = SDL_GetPerformanceCounter();
+        if (redraw_next && !pending)
+        {
+            requested = now;
+            pending = true;
+        }
+        if (!redraw_next || now < next_frame || is_quit)
+            continue;
+
+        update();
+        frame_count++;
+        pending = false;
+
+        // The frame was due at the start of its interval, it is late when presented after the end of it
+        const Uint64 deadline = std::max(requested, next_frame) + interval;
+        const Uint64 presented = SDL_GetPerformanceCounter();
+        if (presented > deadline)
+        {
+            missed_count++;
+            if (frame_late != nullptr)
+                frame_late(double(presented - deadline) * 1000.0 / double(frequency));
         }
+        next_frame = std::max(next_frame, now) + interval;
+    }
+}
+
+unsigned SDLViewer::frames_drawn() const
+{
+    return frame_count;
+}
+
+unsigned SDLViewer::deadlines_missed() const
+{
+    return missed_count;
+}
+
+void SDLViewer::queue_event(const SDL_Event &event)
+{
+    if (event.type == SDL_MOUSEMOTION && !input_events.empty() && input_events.back().type == SDL_MOUSEMOTION)
+    {
+        SDL_MouseMotionEvent &motion = input_events.back().motion;
+        motion.timestamp = event.motion.timestamp;
+        motion.state = event.motion.state;
+        motion.x = event.motion.x;
+        motion.y = event.motion.y;
+        motion.xrel += event.motion.xrel;
+        motion.yrel += event.motion.yrel;
+        return;
+    }
+    input_events.push_back(event);
+}
+
+void SDLViewer::handle_event(const SDL_Event &event)
+{
+    switch (event.type)
+    {
+    case SDL_MOUSEMOTION:
+        if (mouse_move != nullptr)
+            mouse_move(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
+        break;
+
+    case SDL_KEYDOWN:
+    //case SDL_KEYUP:
+        if (key_pressed != nullptr)
+            key_pressed(event.key.keysym.sym, event.key.state == SDL_PRESSED, event.key.keysym.mod, event.key.repeat);
+        break;
+
+    case SDL_MOUSEBUTTONDOWN:
+        if (mouse_pressed != nullptr)
+            mouse_pressed(event.button.x, event.button.y, event.button.state == SDL_PRESSED, event.button.button, event.button.clicks, false);
+        break;
+
+    case SDL_MOUSEBUTTONUP:
+        if (mouse_pressed != nullptr)
+            mouse_pressed(event.button.x, event.button.y, event.button.state == SDL_PRESSED, event.button.button, event.button.clicks, true);
+        break;
+
+    case SDL_MOUSEWHEEL:
+        if (mouse_wheel != nullptr)
+            mouse_wheel(event.wheel.x, event.wheel.y, event.wheel.direction == SDL_MOUSEWHEEL_NORMAL);
+        break;
     }
 }
 
 SDLViewer::~SDLViewer()
 {
+    SDL_FreeSurface(image_surface);
+    image_surface = nullptr;
+
+    if (texture != nullptr)
+        SDL_DestroyTexture(texture);
+    if (renderer != nullptr)
+        SDL_DestroyRenderer(renderer);
+    texture = nullptr;
+    renderer = nullptr;
+
     //Destroy window
     SDL_DestroyWindow(window);
     window = nullptr;
@@ -6,6 +6,9 @@
 #include <SDL_timer.h>
 
 #include <functional>
+#include <vector>
+
+#include "RenderTarget.h"
 
 /*
  * Modifiers:
@@ -30,13 +33,14 @@ KMOD_GUI (KMOD_LGUI|KMOD_RGUI)
  *
  */
 
-class SDLViewer
+class SDLViewer : public RenderTarget
 {
 public:
     SDLViewer();
 
 
-    bool init(const std::string &window_name, const int w, const int h);
+    // With vsync, frames presented through a texture wait for the vertical blank of the display
+    bool init(const std::string &window_name, const int w, const int h, const bool vsync = false);
 
     void resize(const int w, const int h);
 
@@ -46,7 +50,40 @@ public:
         const Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic> &B,
         const Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic> &A);
 
-    void launch(const int redraw_interval = 30);
+    // Presents packed rgba8 pixels with a single blit: h rows of w pixels from the top of the image, pitch bytes apart
+    bool draw_image(const uint8_t *pixels, const int w, const int h, const int pitch);
+
+    // Presents only the rectangles of the image that changed, in window coordinates (y down). The rest of the
+    // window keeps the pixels presented before.
+    bool draw_image(const uint8_t *pixels, const int w, const int h, const int pitch, const std::vector<SDL_Rect> &rects);
+
+    // Locks the pixels of the window so that a frame can be drawn into them in place: rows of rgba8 pixels of the
+    // window from the top, pitch bytes apart. Returns false if the window cannot be drawn into in place.
+    bool lock_image(uint8_t *&pixels, int &pitch);
+
+    // Whether the locked pixels keep the frame presented last. They do with a window surface. With a streaming
+    // texture their content is undefined, every pixel must be written before unlocking.
+    bool image_kept() const;
+
+    // Presents the pixels drawn since lock_image(), all of them or only the rectangles in window coordinates
+    bool unlock_image();
+    bool unlock_image(const std::vector<SDL_Rect> &rects);
+
+    // The window as a render target: frames are drawn into it in place when its pixels keep the last frame, which
+    // only the rgba8 window surfaces do. Otherwise they are presented with draw_image(), which copies the dirty
+    // rectangles to the streaming texture.
+    bool lock_frame(uint8_t *&pixels, int &pitch) override;
+    void unlock_frame(const std::vector<TargetRect> *rects) override;
+    void present_frame(const uint8_t *pixels, const int w, const int h, const int pitch, const std::vector<TargetRect> *rects) override;
+
+    // Runs the event loop until the window is closed. Every redraw requested through redraw_next is merged into
+    // the next frame, drawn at most frame_rate times per second (at the refresh rate of the display if 0).
+    // Without a pending redraw the loop sleeps until the next event.
+    void launch(const int frame_rate = 0);
+
+    // Frames drawn by launch(), and the ones among them presented more than a frame interval after they were due
+    unsigned frames_drawn() const;
+    unsigned deadlines_missed() const;
 
     ~SDLViewer();
 
@@ -62,16 +99,61 @@ public:
     // key, is_pressed, modifier, repeat
     std::function<void(char, bool, int, int)> key_pressed;
 
+    // Events received since the last frame, in order, with the consecutive mouse motions merged into one: the
+    // position of the last one and the sum of the relative motions. When set, it receives the events instead
+    // of the callbacks above.
+    std::function<void(const std::vector<SDL_Event> &)> input_batch;
+
     std::function<void(SDLViewer &)> redraw;
 
+    // Called with the lateness in milliseconds of every frame that missed its deadline
+    std::function<void(double)> frame_late;
+
     void update();
 
     bool redraw_next;
 
 private:
+    // Appends an event to input_events, merging it into the last one when both are mouse motions
+    void queue_event(const SDL_Event &event);
+
+    // Dispatches an event to the callbacks
+    void handle_event(const SDL_Event &event);
+
+    // Wraps the pixels in image_surface, reusing it while they do not move or change size
+    bool wrap_image(const uint8_t *pixels, const int w, const int h, const int pitch);
+
+    // Copies the rectangles of a frame to frame_rects
+    const std::vector<SDL_Rect> &window_rects(const std::vector<TargetRect> &rects);
+
+    // Makes the streaming texture w x h pixels
+    bool size_texture(const int w, const int h);
+
+    // Shows the streaming texture in the window
+    void present_texture();
+
     // The window we'll be rendering to
     SDL_Window *window;
 
-    //The surface contained by the window
+    // The surface contained by the window, used when its pixels are rgba8, so that frames are drawn into it in place
     SDL_Surface *window_surface;
+
+    // Otherwise the frames are uploaded to a streaming rgba8 texture
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    int texture_width, texture_height;
+
+    // Statistics of the frame scheduler
+    unsigned frame_count, missed_count;
+
+    // Events of the next frame, kept from one frame to the next
+    std::vector<SDL_Event> input_events;
+
+    // Rectangles of the frame presented last, kept from one frame to the next
+    std::vector<SDL_Rect> frame_rects;
+
+    // Pixels interleaved from the channels of the last image, and the surface wrapping the pixels last drawn.
+    // They are reused while the pixels do not move or change size.
+    std::vector<uint8_t> image_data;
+    SDL_Surface *image_surface;
 };
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifndef NDEBUG
+namespace
+{
+	std::atomic<uint64_t> allocations(0);
+
+	void* counted_allocation(std::size_t size)
+	{
+		allocations++;
+		while (true)
+		{
+			void* memory = std::malloc(size > 0 ? size : 1);
+			if (memory)
+				return memory;
+
+			// Give the new handler a chance to release memory, as the default operator new does
+			std::new_handler handler = std::get_new_handler();
+			if (!handler)
+				throw std::bad_alloc();
+			handler();
+		}
+	}
+} // namespace
+
+// Replacements of the global allocation functions, every other form forwards to these
+void* operator new(std::size_t size)
+{
+	return counted_allocation(size);
+}
+
+void* operator new[](std::size_t size)
+{
+	return counted_allocation(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	try { return counted_allocation(size); }
+	catch (...) { return nullptr; }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	try { return counted_allocation(size); }
+	catch (...) { return nullptr; }
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	std::free(memory);
+}
+#endif
+
+uint64_t heap_allocation_count()
+{
+#ifndef NDEBUG
+	return allocations;
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Number of allocations made through the global operator new since the program started. They are
+// only counted in debug builds (NDEBUG not defined), release builds always return 0.
+uint64_t heap_allocation_count();
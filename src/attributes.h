@@ -9,6 +9,7 @@ class VertexAttributes
 	{
 		position << x,y,z,w;
 		color << 1,1,1,1;
+		bary_center << 0,0,0,0;
 	}
 
     // Interpolates the vertex attributes
@@ -33,6 +34,35 @@ class VertexAttributes
 	bool selected = false;
 };
 
+// A horizontal run of pixels processed at once by the span shaders
+class FragmentSpan
+{
+	public:
+	// Interpolated attributes at the center of pixel k of the span
+	VertexAttributes at(int k) const
+	{
+		VertexAttributes r;
+		r.position = start.position + float(k)*dx.position;
+		r.color = start.color + float(k)*dx.color;
+		return r;
+	}
+
+	// Whether pixel k of the span is covered
+	bool covered(int k) const
+	{
+		return mask == nullptr || mask[k] != 0;
+	}
+
+	// First pixel of the span and number of pixels
+	int x, y;
+	int count;
+	// 0xFF for the covered pixels and 0 for the others, nullptr if every pixel is covered
+	const uint8_t* mask;
+	// Attributes at the first pixel center, and their increment from one pixel to the next
+	VertexAttributes start;
+	VertexAttributes dx;
+};
+
 class FragmentAttributes
 {
 	public:
@@ -55,6 +85,22 @@ class FrameBufferAttributes
 	Eigen::Matrix<uint8_t,4,1> color;
 };
 
+// Placement of one instance of an instanced draw
+class InstanceAttributes
+{
+	public:
+	InstanceAttributes()
+	{
+		transform.setIdentity();
+		color << 1,1,1,1;
+	}
+
+	// Applied to the positions after the vertex shader
+	Eigen::Matrix4f transform;
+	// Multiplies the colors after the vertex shader
+	Eigen::Vector4f color;
+};
+
 class UniformAttributes
 {
 	public:
@@ -1,8 +1,116 @@
 #include "raster.h"	
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <limits>
 
-void rasterize_triangle(const Program& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, FrameBuffer& frameBuffer)
+namespace raster_detail
 {
+	// Floor of a/b for b > 0
+	inline int64_t floor_div(int64_t a, int64_t b)
+	{
+		return a >= 0 ? a/b : -((-a+b-1)/b);
+	}
+
+	// Planes of the clipping volume, as signed distances which are positive inside
+	const int CLIP_PLANES = 5;
+
+	inline float clip_distance(const Eigen::Vector4f& p, int plane, float scale)
+	{
+		switch (plane)
+		{
+			case 0: return p[3]-W_NEAR;
+			case 1: return scale*p[3]+p[0];
+			case 2: return scale*p[3]-p[0];
+			case 3: return scale*p[3]+p[1];
+			default: return scale*p[3]-p[1];
+		}
+	}
+
+	// Bit i is set when the vertex is outside of plane i, scaled by scale. Bits 5 and 6 are the
+	// depth range, which is not clipped but allows to reject triangles.
+	inline int outcode(const Eigen::Vector4f& p, float scale)
+	{
+		int code = 0;
+		for (int plane=0; plane<CLIP_PLANES; plane++)
+			if (clip_distance(p,plane,scale) < 0)
+				code |= 1 << plane;
+		if (p[3]+p[2] < 0)
+			code |= 1 << 5;
+		if (p[3]-p[2] < 0)
+			code |= 1 << 6;
+		return code;
+	}
+
+	void clip_triangle(std::vector<VertexAttributes>& v, unsigned a, unsigned b, unsigned c, std::vector<unsigned>& triangles)
+	{
+		// Outside of one of the planes of the view volume
+		if (outcode(v[a].position,1) & outcode(v[b].position,1) & outcode(v[c].position,1))
+			return;
+
+		// Within the guard band, the rasterizer only visits the pixels of the viewport anyway
+		const int band = (1 << CLIP_PLANES) - 1;
+		if (((outcode(v[a].position,GUARD_BAND) | outcode(v[b].position,GUARD_BAND) | outcode(v[c].position,GUARD_BAND)) & band) == 0)
+		{
+			triangles.push_back(a);
+			triangles.push_back(b);
+			triangles.push_back(c);
+			return;
+		}
+
+		// Sutherland-Hodgman, each plane adds at most one vertex to the polygon
+		VertexAttributes polygon[2][3+CLIP_PLANES];
+		int count = 3;
+		polygon[0][0] = v[a];
+		polygon[0][1] = v[b];
+		polygon[0][2] = v[c];
+		for (int plane=0; plane<CLIP_PLANES; plane++)
+		{
+			const VertexAttributes* in = polygon[plane%2];
+			VertexAttributes* out = polygon[(plane+1)%2];
+			int out_count = 0;
+			for (int k=0; k<count; k++)
+			{
+				const VertexAttributes& p = in[k];
+				const VertexAttributes& q = in[(k+1)%count];
+				const float dp = clip_distance(p.position,plane,1);
+				const float dq = clip_distance(q.position,plane,1);
+				if (dp >= 0)
+					out[out_count++] = p;
+				if ((dp >= 0) != (dq >= 0))
+				{
+					// Always interpolate from the inside vertex, so that the triangles sharing the
+					// edge get the exact same vertex
+					const VertexAttributes& i = dp >= 0 ? p : q;
+					const VertexAttributes& o = dp >= 0 ? q : p;
+					const float di = dp >= 0 ? dp : dq;
+					const float d_o = dp >= 0 ? dq : dp;
+					const float t = di/(di-d_o);
+					VertexAttributes r = i;
+					r.position = (1-t)*i.position + t*o.position;
+					r.color = (1-t)*i.color + t*o.color;
+					out[out_count++] = r;
+				}
+			}
+			count = out_count;
+			if (count < 3)
+				return;
+		}
+
+		// Triangulate the convex polygon as a fan
+		const VertexAttributes* clipped = polygon[CLIP_PLANES%2];
+		const unsigned first = v.size();
+		v.insert(v.end(),clipped,clipped+count);
+		for (int k=1; k+1<count; k++)
+		{
+			triangles.push_back(first);
+			triangles.push_back(first+k);
+			triangles.push_back(first+k+1);
+		}
+	}
+
+	bool setup_triangle(const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, int width, int height, TriangleSetup& setup)
+	{
 		// Collect coordinates into a matrix and convert to canonical representation
 		Eigen::Matrix<float,3,4> p;
 		p.row(0) = v1.position.array()/v1.position[3];
@@ -10,136 +118,467 @@ void rasterize_triangle(const Program& program, const UniformAttributes& uniform
 		p.row(2) = v3.position.array()/v3.position[3];
 
 		// Coordinates are in -1..1, rescale to pixel size (x,y only)
-		p.col(0) = ((p.col(0).array()+1.0)/2.0)*frameBuffer.rows();		
-		p.col(1) = ((p.col(1).array()+1.0)/2.0)*frameBuffer.cols();
+		p.col(0) = ((p.col(0).array()+1.0)/2.0)*width;
+		p.col(1) = ((p.col(1).array()+1.0)/2.0)*height;
+
+		// Snap the vertices to the subpixel grid. The edge functions are then computed exactly, so
+		// adjacent triangles agree on which pixel centers lie on their shared edge.
+		// Coordinates out of range (including NaN and infinity) cannot be represented.
+		if (!(p.leftCols(2).array().abs() < MAX_COORDINATE).all())
+			return false;
+		int64_t X[3], Y[3];
+		for (int k=0; k<3; k++)
+		{
+			X[k] = std::llround(p(k,0)*SUBPIXEL_SCALE);
+			Y[k] = std::llround(p(k,1)*SUBPIXEL_SCALE);
+		}
+
+		const VertexAttributes* v[3] = {&v1, &v2, &v3};
 
-		// Find bounding box in pixels
-		int lx = std::floor(p.col(0).minCoeff());
-		int ly = std::floor(p.col(1).minCoeff());
-		int ux = std::ceil(p.col(0).maxCoeff());
-		int uy = std::ceil(p.col(1).maxCoeff());
+		// Twice the signed area, zero for degenerate triangles which cover no pixel
+		int64_t area = (X[1]-X[0])*(Y[2]-Y[0]) - (Y[1]-Y[0])*(X[2]-X[0]);
+		if (area == 0)
+			return false;
+
+		// Make the triangle counterclockwise, so that the edge functions are positive inside
+		if (area < 0)
+		{
+			std::swap(X[1],X[2]);
+			std::swap(Y[1],Y[2]);
+			std::swap(v[1],v[2]);
+			area = -area;
+		}
+
+		// Find the bounding box of the pixel centers, which lie at i+0.5
+		const int64_t half = SUBPIXEL_SCALE/2;
+		const int64_t lx = -floor_div(-(*std::min_element(X,X+3)-half),SUBPIXEL_SCALE);
+		const int64_t ly = -floor_div(-(*std::min_element(Y,Y+3)-half),SUBPIXEL_SCALE);
+		const int64_t ux = floor_div(*std::max_element(X,X+3)-half,SUBPIXEL_SCALE);
+		const int64_t uy = floor_div(*std::max_element(Y,Y+3)-half,SUBPIXEL_SCALE);
+
+		// Triangles entirely outside cannot cover any pixel center
+		if (ux < 0 || uy < 0 || lx > width-1 || ly > height-1 || lx > ux || ly > uy)
+			return false;
 
 		// Clamp to framebuffer
-		lx = std::min(std::max(lx,int(0)),int(frameBuffer.rows()-1));
-		ly = std::min(std::max(ly,int(0)),int(frameBuffer.cols()-1));
-		ux = std::min(std::max(ux,int(0)),int(frameBuffer.rows()-1));
-		uy = std::min(std::max(uy,int(0)),int(frameBuffer.cols()-1));
+		setup.box.lx = int(std::max<int64_t>(lx,0));
+		setup.box.ly = int(std::max<int64_t>(ly,0));
+		setup.box.ux = int(std::min<int64_t>(ux,width-1));
+		setup.box.uy = int(std::min<int64_t>(uy,height-1));
 
-		// Build the implicit triangle representation
-		Eigen::Matrix3f A;
-		A.col(0) = p.row(0).segment(0,3);
-		A.col(1) = p.row(1).segment(0,3);
-		A.col(2) = p.row(2).segment(0,3);
-		A.row(2) << 1.0, 1.0, 1.0;
+		// Edge k goes from vertex k+1 to vertex k+2: e_k(p) = cross(v[k+2]-v[k+1], p-v[k+1]),
+		// evaluated at the pixel centers and stepped by one pixel along x and y
+		for (int k=0; k<3; k++)
+		{
+			const int a = (k+1)%3;
+			const int b = (k+2)%3;
+			const int64_t dx = X[b]-X[a];
+			const int64_t dy = Y[b]-Y[a];
+			setup.A[k] = -dy*SUBPIXEL_SCALE;
+			setup.B[k] = dx*SUBPIXEL_SCALE;
+			setup.C[k] = dx*(half-Y[a]) - dy*(half-X[a]);
 
-		Eigen::Matrix3f Ai = A.inverse();
+			// Top-left rule: pixel centers exactly on an edge belong to the triangle on its right or
+			// below it. With y up and counterclockwise order, left edges go down and top edges go left.
+			const bool top_left = dy < 0 || (dy == 0 && dx < 0);
+			setup.bias[k] = top_left ? 0 : -1;
+		}
+		setup.inv_area = 1.0/double(area);
 
-		// Rasterize the triangle
-		for (unsigned i=lx; i<=ux; i++)
+		// The barycentric coordinates are affine in the pixel position: they are stepped by a
+		// constant increment along x. The interpolated attributes are affine in the barycentric
+		// coordinates, so they share the same stepping, in the same form as interpolate().
+		Eigen::Vector3f b_dx, b_dy;
+		for (int k=0; k<3; k++)
 		{
-			for (unsigned j=ly; j<=uy; j++)
+			b_dx[k] = float(setup.A[k]*setup.inv_area);
+			b_dy[k] = float(setup.B[k]*setup.inv_area);
+		}
+		setup.position_dx = b_dx[1]*(v[1]->position-v[0]->position) + b_dx[2]*(v[2]->position-v[0]->position);
+		setup.position_dy = b_dy[1]*(v[1]->position-v[0]->position) + b_dy[2]*(v[2]->position-v[0]->position);
+		setup.color_dx = b_dx[1]*(v[1]->color-v[0]->color) + b_dx[2]*(v[2]->color-v[0]->color);
+
+		const Eigen::Vector3f z(v1.position[2],v2.position[2],v3.position[2]);
+		setup.z_epsilon = BLOCK_EPSILON*(1 + z.cwiseAbs().maxCoeff());
+
+		for (int k=0; k<3; k++)
+			setup.v[k] = v[k];
+		return true;
+	}
+
+	// Edge functions and depth are affine, so their extrema lie at the corners. The edge functions
+	// are exact, only the depth needs a tolerance.
+	BlockCoverage classify_block(const TriangleSetup& setup, int lx, int ly, int ux, int uy)
+	{
+		bool inside = true;
+		for (int k=0; k<3; k++)
+		{
+			const int64_t e = edge_function(setup,k,lx,ly) + setup.bias[k];
+			const int64_t e_x = setup.A[k]*(ux-lx);
+			const int64_t e_y = setup.B[k]*(uy-ly);
+			if (e + std::max<int64_t>(e_x,0) + std::max<int64_t>(e_y,0) < 0)
+				return BLOCK_OUTSIDE;
+			inside = inside && e + std::min<int64_t>(e_x,0) + std::min<int64_t>(e_y,0) >= 0;
+		}
+
+		VertexAttributes va;
+		interpolate(setup,lx,ly,va);
+		const float z = va.position[2];
+		const float z_x = setup.position_dx[2]*(ux-lx);
+		const float z_y = setup.position_dy[2]*(uy-ly);
+		const float z_min = z + std::min(z_x,0.0f) + std::min(z_y,0.0f);
+		const float z_max = z + std::max(z_x,0.0f) + std::max(z_y,0.0f);
+
+		if (z_max < -1-setup.z_epsilon || z_min > 1+setup.z_epsilon)
+			return BLOCK_OUTSIDE;
+		if (inside && z_min > -1+setup.z_epsilon && z_max < 1-setup.z_epsilon)
+			return BLOCK_INSIDE;
+		return BLOCK_PARTIAL;
+	}
+
+	OverdrawBuffer*& overdraw_buffer()
+	{
+		static OverdrawBuffer* overdraw = nullptr;
+		return overdraw;
+	}
+
+	DrawScratch& draw_scratch()
+	{
+		static thread_local DrawScratch scratch;
+		return scratch;
+	}
+
+	// Where the linear function a*x+b is within [lo,hi], intersected with [x0,x1]
+	inline void clip_range(float a, float b, float lo, float hi, float& x0, float& x1)
+	{
+		if (a == 0)
+		{
+			if (b < lo || b > hi)
+				x1 = -std::numeric_limits<float>::infinity();
+			return;
+		}
+		const float s0 = (lo-b)/a;
+		const float s1 = (hi-b)/a;
+		x0 = std::max(x0,std::min(s0,s1));
+		x1 = std::min(x1,std::max(s0,s1));
+	}
+
+	// The capsule is convex, so its intersection with the row is the hull of those of its pieces:
+	// the two end discs and the band along the segment
+	bool capsule_row(const Eigen::Vector2f& l1, const Eigen::Vector2f& l2, float r, float y, float& x0, float& x1)
+	{
+		const float inf = std::numeric_limits<float>::infinity();
+		x0 = inf;
+		x1 = -inf;
+
+		const Eigen::Vector2f* ends[2] = {&l1, &l2};
+		for (int k=0; k<2; k++)
+		{
+			const float dy = y-(*ends[k])[1];
+			if (dy*dy <= r*r)
 			{
-				// The pixel center is offset by 0.5, 0.5
-				Eigen::Vector3f pixel(i+0.5,j+0.5,1);
-				Eigen::Vector3f b = Ai*pixel;
-				if (b.minCoeff() >= 0)
-				{
-					VertexAttributes va = VertexAttributes::interpolate(v1,v2,v3,b[0],b[1],b[2]);
-					// Only render fragments within the bi-unit cube
-					if (va.position[2] >= -1 && va.position[2] <= 1)
-					{ 
-						FragmentAttributes frag = program.FragmentShader(va,uniform);
-						frameBuffer(i,j) = program.BlendingShader(frag,frameBuffer(i,j));
-					}
-				}
+				const float h = std::sqrt(r*r-dy*dy);
+				x0 = std::min(x0,(*ends[k])[0]-h);
+				x1 = std::max(x1,(*ends[k])[0]+h);
 			}
 		}
+
+		// Projection on the segment within 0..1 and distance to the line below r
+		const Eigen::Vector2f d = l2-l1;
+		const float ll = d.squaredNorm();
+		if (ll > 0)
+		{
+			float b0 = -inf, b1 = inf;
+			clip_range(d[0],(y-l1[1])*d[1]-l1[0]*d[0],0,ll,b0,b1);
+			const float w = r*std::sqrt(ll);
+			clip_range(d[1],-(y-l1[1])*d[0]-l1[0]*d[1],-w,w,b0,b1);
+			if (b0 <= b1)
+			{
+				x0 = std::min(x0,b0);
+				x1 = std::max(x1,b1);
+			}
+		}
+		return x0 <= x1;
+	}
+
+	unsigned depth_order(const std::vector<VertexAttributes>& v, const std::vector<unsigned>& triangles, bool depth, std::vector<unsigned>& order)
+	{
+		const unsigned n = triangles.size()/3;
+		order.resize(n);
+		for (unsigned i=0; i<n; i++)
+			order[i] = i;
+		if (!depth)
+			return 0;
+
+		// Opaque triangles in reverse order, then the others
+		auto opaque = [&](unsigned t)
+		{
+			return v[triangles[t*3+0]].color[3] >= 1 && v[triangles[t*3+1]].color[3] >= 1 && v[triangles[t*3+2]].color[3] >= 1;
+		};
+		order.clear();
+		for (unsigned i=n; i-- > 0;)
+			if (opaque(i))
+				order.push_back(i);
+		const unsigned opaque_count = order.size();
+		for (unsigned i=0; i<n; i++)
+			if (!opaque(i))
+				order.push_back(i);
+
+		// Translucent triangles from back to front, by their farthest vertex
+		auto far_depth = [&](unsigned t)
+		{
+			float z = -std::numeric_limits<float>::infinity();
+			for (int k=0; k<3; k++)
+				z = std::max(z,v[triangles[t*3+k]].position[2]/v[triangles[t*3+k]].position[3]);
+			return z;
+		};
+		// Ties keep submission order, like a stable sort but without its temporary buffer
+		std::sort(order.begin()+opaque_count,order.end(),[&](unsigned a, unsigned b)
+		{
+			const float za = far_depth(a);
+			const float zb = far_depth(b);
+			return za > zb || (za == zb && a < b);
+		});
+		return opaque_count;
+	}
+
+	void bin_triangles(const std::vector<TriangleSetup,Eigen::aligned_allocator<TriangleSetup> >& setups, int width, int height, TileBins& bins)
+	{
+		// Counting sort, which keeps submission order (and thus painter order) within each bin
+		bins.tiles_x = (width+TILE_SIZE-1)/TILE_SIZE;
+		bins.tiles_y = (height+TILE_SIZE-1)/TILE_SIZE;
+		bins.offset.assign(bins.tiles_x*bins.tiles_y+1,0);
+		for (unsigned i=0; i<setups.size(); i++)
+			for (int ty=setups[i].box.ly/TILE_SIZE; ty<=setups[i].box.uy/TILE_SIZE; ty++)
+				for (int tx=setups[i].box.lx/TILE_SIZE; tx<=setups[i].box.ux/TILE_SIZE; tx++)
+					bins.offset[ty*bins.tiles_x+tx+1]++;
+
+		for (unsigned t=1; t<bins.offset.size(); t++)
+			bins.offset[t] += bins.offset[t-1];
+
+		bins.items.resize(bins.offset.back());
+		std::vector<unsigned>& fill = bins.fill;
+		fill.assign(bins.offset.begin(),bins.offset.end()-1);
+		for (unsigned i=0; i<setups.size(); i++)
+			for (int ty=setups[i].box.ly/TILE_SIZE; ty<=setups[i].box.uy/TILE_SIZE; ty++)
+				for (int tx=setups[i].box.lx/TILE_SIZE; tx<=setups[i].box.ux/TILE_SIZE; tx++)
+					bins.items[fill[ty*bins.tiles_x+tx]++] = i;
+	}
+
+	PixelRect tile_rect(const TileBins& bins, int t, int width, int height)
+	{
+		const int tx = t%bins.tiles_x;
+		const int ty = t/bins.tiles_x;
+		const PixelRect rect = {tx*TILE_SIZE, ty*TILE_SIZE, std::min((tx+1)*TILE_SIZE,width)-1, std::min((ty+1)*TILE_SIZE,height)-1};
+		return rect;
+	}
+} // namespace raster_detail
+
+void rasterize_triangle(const Program& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, FrameBuffer& frameBuffer)
+{
+	const raster_detail::DepthTest depth = {nullptr, false};
+	raster_detail::rasterize_single_triangle(program,uniform,v1,v2,v3,depth,frameBuffer);
 }
 
 void rasterize_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer)
 {
-	// Call vertex shader on all vertices
-	std::vector<VertexAttributes> v(vertices.size());
-	for (unsigned i=0; i<vertices.size();i++)
-		v[i] = program.VertexShader(vertices[i],uniform);
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_LIST,nullptr,frameBuffer);
+}
+
+void rasterize_triangle(const Program& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	const raster_detail::DepthTest depth = {&depthBuffer, true};
+	raster_detail::rasterize_single_triangle(program,uniform,v1,v2,v3,depth,frameBuffer);
+}
 
-	// Call the rasterization function on every triangle
-	for (unsigned i=0; i<vertices.size()/3; i++)
-		rasterize_triangle(program,uniform,v[i*3+0],v[i*3+1],v[i*3+2],frameBuffer);
+void rasterize_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_LIST,&depthBuffer,frameBuffer);
+}
+
+void rasterize_indexed_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<unsigned>& indices, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_indexed_triangles(program,uniform,vertices,indices,nullptr,frameBuffer);
+}
+
+void rasterize_indexed_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<unsigned>& indices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_indexed_triangles(program,uniform,vertices,indices,&depthBuffer,frameBuffer);
+}
+
+void rasterize_triangle_strip(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_STRIP,nullptr,frameBuffer);
+}
+
+void rasterize_triangle_strip(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_STRIP,&depthBuffer,frameBuffer);
+}
+
+void rasterize_triangle_fan(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_FAN,nullptr,frameBuffer);
+}
+
+void rasterize_triangle_fan(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_FAN,&depthBuffer,frameBuffer);
+}
+
+void rasterize_instanced_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<InstanceAttributes>& instances, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_instanced_triangles(program,uniform,vertices,instances,nullptr,frameBuffer);
+}
+
+void rasterize_instanced_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<InstanceAttributes>& instances, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_instanced_triangles(program,uniform,vertices,instances,&depthBuffer,frameBuffer);
 }
 
 void rasterize_line(const Program& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, float line_thickness, FrameBuffer& frameBuffer)
 {
-		// Collect coordinates into a matrix and convert to canonical representation
-		Eigen::Matrix<float,2,4> p;
-		p.row(0) = v1.position.array()/v1.position[3];
-		p.row(1) = v2.position.array()/v2.position[3];
+	StageClock clock;
+	raster_detail::rasterize_line(program,uniform,v1,v2,line_thickness,frameBuffer);
+	clock.lap(STAGE_RASTER);
+}
 
-		// Coordinates are in -1..1, rescale to pixel size (x,y only)
-		p.col(0) = ((p.col(0).array()+1.0)/2.0)*frameBuffer.rows();	
-		p.col(1) = ((p.col(1).array()+1.0)/2.0)*frameBuffer.cols();
+void rasterize_lines(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_lines(program,uniform,vertices,line_thickness,frameBuffer);
+}
 
-		// Find bounding box in pixels, adding the line thickness
-		int lx = std::floor(p.col(0).minCoeff()-line_thickness);
-		int ly = std::floor(p.col(1).minCoeff()-line_thickness);
-		int ux = std::ceil(p.col(0).maxCoeff()+line_thickness);
-		int uy = std::ceil(p.col(1).maxCoeff()+line_thickness);
+void rasterize_line_strip(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_line_strip(program,uniform,vertices,line_thickness,frameBuffer);
+}
 
-		// Clamp to framebuffer
-		lx = std::min(std::max(lx,int(0)),int(frameBuffer.rows()-1));
-		ly = std::min(std::max(ly,int(0)),int(frameBuffer.cols()-1));
-		ux = std::min(std::max(ux,int(0)),int(frameBuffer.rows()-1));
-		uy = std::min(std::max(uy,int(0)),int(frameBuffer.cols()-1));
+static_assert(sizeof(FrameBufferAttributes) == 4, "the framebuffer stores packed rgba8 pixels");
 
-		// We only need the 2d coordinates of the endpoints of the line
-		Eigen::Vector2f l1(p(0,0),p(0,1));
-		Eigen::Vector2f l2(p(1,0),p(1,1));
+const int FrameBuffer::TILE_SIZE;
 
-		// Parametrize the line as l1 + t (l2-l1)
-		float t = -1;
-		float ll  = (l1-l2).squaredNorm();
+void FrameBuffer::clear(const FrameBufferAttributes& color)
+{
+	StageClock clock;
+	for (int y=0; y<h; y++)
+		fill_span(color.color.data(),w,&(*this)(0,y).color[0]);
+	clear_color = color;
+	std::fill(tiles.begin(),tiles.end(),uint8_t(TILE_CLEAR));
+	clock.lap(STAGE_CLEAR);
+}
 
-		// Rasterize the line
-		for (unsigned i=lx; i<=ux; i++)
-		{
-			for (unsigned j=ly; j<=uy; j++)
-			{
-				// The pixel center is offset by 0.5, 0.5
-				Eigen::Vector2f pixel(i+0.5,j+0.5);
+void FrameBuffer::clear(const FrameBufferAttributes& color, int lx, int ly, int ux, int uy)
+{
+	lx = std::max(lx,0);
+	ly = std::max(ly,0);
+	ux = std::min(ux,w-1);
+	uy = std::min(uy,h-1);
+	if (lx > ux || ly > uy)
+		return;
 
-				if (ll == 0.0)
-					// The segment has zero length
-					t = 0;
-				else
-				{
-					// Project p on the line
-					t = (pixel-l1).dot(l2-l1)/ll;
-					// Clamp between 0 and 1
-					t = std::fmax(0, std::fmin(1, t));
-				}
+	// The rest of the tiles keeps its pixels, fill the flagged ones first
+	StageClock clock;
+	prepare(lx,ly,ux,uy);
+	for (int y=ly; y<=uy; y++)
+		fill_span(color.color.data(),ux-lx+1,&(*this)(lx,y).color[0]);
+	clock.lap(STAGE_CLEAR);
+}
 
-  				Eigen::Vector2f pixel_p = l1 + t * (l2 - l1);
-				
-				if ((pixel - pixel_p).squaredNorm() < (line_thickness*line_thickness))
-				{
-					VertexAttributes va = VertexAttributes::interpolate(v1,v2,v1,1-t,t,0);
-					FragmentAttributes frag = program.FragmentShader(va,uniform);
-					frameBuffer(i,j) = program.BlendingShader(frag,frameBuffer(i,j));
-				}
-			}
+void FrameBuffer::copy(const FrameBuffer& source, int lx, int ly, int ux, int uy)
+{
+	lx = std::max(lx,0);
+	ly = std::max(ly,0);
+	ux = std::min(ux,w-1);
+	uy = std::min(uy,h-1);
+	if (lx > ux || ly > uy)
+		return;
+
+	// The rows are copied as their packed rgba8 bytes
+	prepare(lx,ly,ux,uy);
+	const size_t bytes = size_t(ux-lx+1)*4;
+	for (int y=ly; y<=uy; y++)
+		std::memcpy(pixels()+size_t(h-1-y)*stride+lx*4,source.pixels()+size_t(source.height()-1-y)*source.pitch()+lx*4,bytes);
+}
+
+void FrameBuffer::set_scissor(int lx, int ly, int ux, int uy)
+{
+	scissor_box[0] = std::max(lx,0);
+	scissor_box[1] = std::max(ly,0);
+	scissor_box[2] = std::min(ux,w-1);
+	scissor_box[3] = std::min(uy,h-1);
+}
+
+void FrameBuffer::clear_deferred(const FrameBufferAttributes& color)
+{
+	// Tiles already filled with the same color stay as they are
+	StageClock clock;
+	const bool same = color.color == clear_color.color;
+	for (unsigned t=0; t<tiles.size(); t++)
+		if (tiles[t] != TILE_CLEAR || !same)
+			tiles[t] = TILE_CLEAR_PENDING;
+	clear_color = color;
+	clock.lap(STAGE_CLEAR);
+}
+
+void FrameBuffer::resolve_clear()
+{
+	StageClock clock;
+	for (unsigned t=0; t<tiles.size(); t++)
+	{
+		if (tiles[t] == TILE_CLEAR_PENDING)
+		{
+			fill_tile(t%tiles_x,t/tiles_x);
+			tiles[t] = TILE_CLEAR;
 		}
+	}
+	clock.lap(STAGE_CLEAR);
 }
 
-void rasterize_lines(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer)
+void FrameBuffer::prepare(int lx, int ly, int ux, int uy)
+{
+	lx = std::max(lx,0);
+	ly = std::max(ly,0);
+	ux = std::min(ux,w-1);
+	uy = std::min(uy,h-1);
+	if (lx > ux || ly > uy)
+		return;
+
+	for (int ty=ly/TILE_SIZE; ty<=uy/TILE_SIZE; ty++)
+		for (int tx=lx/TILE_SIZE; tx<=ux/TILE_SIZE; tx++)
+			prepare_tile(tx*TILE_SIZE,ty*TILE_SIZE);
+}
+
+void FrameBuffer::fill_tile(int tx, int ty)
+{
+	const int lx = tx*TILE_SIZE;
+	const int count = std::min(w-lx,int(TILE_SIZE));
+	for (int y=ty*TILE_SIZE; y<std::min(h,(ty+1)*TILE_SIZE); y++)
+		fill_span(clear_color.color.data(),count,&(*this)(lx,y).color[0]);
+}
+
+void SpanBlender::operator()(const FragmentSpan& span, const FragmentAttributes* fragments, FrameBufferAttributes* pixels) const
 {
-	// Call vertex shader on all vertices
-	std::vector<VertexAttributes> v(vertices.size());
-	for (unsigned i=0; i<vertices.size();i++)
-		v[i] = program.VertexShader(vertices[i],uniform);
+	static_assert(sizeof(FragmentAttributes) % sizeof(float) == 0, "fragment colors must be a whole number of floats apart");
 
-	// Call the rasterization function on every line
-	for (unsigned i=0; i<vertices.size()/2; i++)
-		rasterize_line(program,uniform,v[i*2+0],v[i*2+1],line_thickness,frameBuffer);
+	uint8_t source[MAX_SPAN_LENGTH*4];
+	premultiply_span(fragments[0].color.data(),sizeof(FragmentAttributes)/sizeof(float),span.count,source);
+	blend_span(mode,source,span.mask,span.count,pixels[0].color.data());
+}
+
+void composite_layer(const RasterLayer& layer, BlendMode mode, FrameBuffer& frameBuffer)
+{
+	const FrameBuffer& source = layer.frameBuffer;
+	const int lx = frameBuffer.scissor_lx();
+	const int ly = frameBuffer.scissor_ly();
+	const int ux = std::min(frameBuffer.scissor_ux(),source.width()-1);
+	const int uy = std::min(frameBuffer.scissor_uy(),source.height()-1);
+	if (lx > ux || ly > uy)
+		return;
+
+	// The layer pixels are already premultiplied, every one of them is blended
+	frameBuffer.prepare(lx,ly,ux,uy);
+	for (int y=ly; y<=uy; y++)
+		blend_span(mode,source(lx,y).color.data(),nullptr,ux-lx+1,frameBuffer(lx,y).color.data());
 }
 
 void framebuffer_to_uint8(const FrameBuffer& frameBuffer, std::vector<uint8_t>& image)
@@ -148,17 +587,42 @@ void framebuffer_to_uint8(const FrameBuffer& frameBuffer, std::vector<uint8_t>&
 	const int h = frameBuffer.cols();                              // Image height
 	const int comp = 4;                                  // 4 Channels Red, Green, Blue, Alpha
 	const int stride_in_bytes = w*comp;                  // Length of one row in bytes
+	StageClock clock;
 	image.resize(w*h*comp,0);         // The image itself;
 
-	for (unsigned wi = 0; wi < w; ++wi) 
+	// The framebuffer rows are already top-down rgba8, only the padding of the pitch is dropped
+	for (int hi = 0; hi < h; ++hi)
+		std::memcpy(&image[hi * stride_in_bytes], frameBuffer.pixels() + hi * frameBuffer.pitch(), stride_in_bytes);
+	clock.lap(STAGE_CONVERT);
+}
+
+void set_overdraw_buffer(OverdrawBuffer* overdraw)
+{
+	raster_detail::overdraw_buffer() = overdraw;
+}
+
+void overdraw_to_heatmap(const OverdrawBuffer& overdraw, bool tested, FrameBuffer& frameBuffer)
+{
+	// Color of 0, 1, ... 8 fragments, larger counts are clamped
+	const int steps = 8;
+	const uint8_t ramp[steps+1][3] = {
+		{0, 0, 0}, {0, 0, 255}, {0, 255, 255}, {0, 255, 0}, {255, 255, 0},
+		{255, 128, 0}, {255, 0, 0}, {255, 128, 128}, {255, 255, 255}
+	};
+
+	// Every pixel is overwritten, row by row as both buffers store them
+	const int w = frameBuffer.rows();
+	const int h = frameBuffer.cols();
+	StageClock clock;
+	frameBuffer.prepare(0,0,w-1,h-1);
+	for (int j=0; j<h; j++)
 	{
-		for (unsigned hi = 0; hi < h; ++hi) 
+		for (int i=0; i<w; i++)
 		{
-			unsigned hif = h-1-hi;
-			image[(hi * w * 4) + (wi * 4) + 0] = frameBuffer(wi,hif).color[0];
-			image[(hi * w * 4) + (wi * 4) + 1] = frameBuffer(wi,hif).color[1];
-			image[(hi * w * 4) + (wi * 4) + 2] = frameBuffer(wi,hif).color[2];
-			image[(hi * w * 4) + (wi * 4) + 3] = frameBuffer(wi,hif).color[3];
+			const uint32_t count = tested ? overdraw(i,j).tested : overdraw(i,j).shaded;
+			const uint8_t* color = ramp[std::min<uint32_t>(count,steps)];
+			frameBuffer(i,j) = FrameBufferAttributes(color[0],color[1],color[2],255);
 		}
 	}
+	clock.lap(STAGE_CONVERT);
 }
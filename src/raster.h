@@ -2,23 +2,291 @@
 
 #include <Eigen/Core>
 #include <Eigen/LU> // Needed for .inverse()
+#include <array>
+#include <functional>
 #include <vector>
 #include <string>
 #include "attributes.h"
+#include "raster_simd.h"
+#include "raster_stats.h"
 
-// Stores the final image
-typedef Eigen::Matrix<FrameBufferAttributes,Eigen::Dynamic,Eigen::Dynamic> FrameBuffer;
+// Stores the final image. Pixels are indexed (x,y) with y going up, like the Eigen matrix it replaces,
+// but stored top-down: the rgba8 pixels of row y are packed from pixels() + (height-1-y)*pitch().
+// This is the layout of a 32 bit SDL surface, so the framebuffer can be presented with a single blit,
+// or draw directly into the pixels of a surface.
+//
+// The framebuffer can also be cleared lazily, per square tile: clear_deferred() only flags the tiles,
+// the rasterizer fills a flagged tile just before it first draws into it, and resolve_clear() fills the
+// tiles left untouched before the pixels are read. Tiles whose pixels already hold the clear color, because
+// nothing was drawn into them since they were last filled, are not written again.
+class FrameBuffer
+{
+	public:
+	// Side of the tiles of the deferred clear. They are the binning tiles of the rasterizer, so the
+	// threads drawing separate tiles never share a flag.
+	static const int TILE_SIZE = 64;
+
+	FrameBuffer() : w(0), h(0), stride(0), external(nullptr) { bind(); }
+	FrameBuffer(int width, int height) : external(nullptr) { resize(width,height); }
+	// Wraps pixels owned by the caller, such as the pixels of a locked SDL surface
+	FrameBuffer(int width, int height, uint8_t* pixels, int pitch) : w(width), h(height), stride(pitch), external(pixels) { bind(); }
+
+	FrameBuffer(const FrameBuffer& other)
+		: w(other.w), h(other.h), stride(other.stride), external(other.external), storage(other.storage), clear_color(other.clear_color)
+	{
+		bind();
+		tiles = other.tiles;
+		scissor_box = other.scissor_box;
+	}
+	FrameBuffer& operator=(const FrameBuffer& other)
+	{
+		w = other.w;
+		h = other.h;
+		stride = other.stride;
+		external = other.external;
+		storage = other.storage;
+		bind();
+		tiles = other.tiles;
+		scissor_box = other.scissor_box;
+		clear_color = other.clear_color;
+		return *this;
+	}
+
+	// Allocates width x height pixels owned by the framebuffer
+	void resize(int width, int height)
+	{
+		w = width;
+		h = height;
+		stride = 4*width;
+		external = nullptr;
+		storage.resize(size_t(width)*height);
+		bind();
+	}
+
+	int width() const { return w; }
+	int height() const { return h; }
+	// Width and height, under the names of the Eigen matrix
+	int rows() const { return w; }
+	int cols() const { return h; }
+
+	// First byte of the top row, rows are pitch() bytes apart
+	uint8_t* pixels() { return top; }
+	const uint8_t* pixels() const { return top; }
+	int pitch() const { return stride; }
+
+	FrameBufferAttributes& operator()(int x, int y) { return reinterpret_cast<FrameBufferAttributes*>(bottom-ptrdiff_t(y)*stride)[x]; }
+	const FrameBufferAttributes& operator()(int x, int y) const { return reinterpret_cast<const FrameBufferAttributes*>(bottom-ptrdiff_t(y)*stride)[x]; }
+
+	// Sets every pixel to color
+	void clear(const FrameBufferAttributes& color);
+
+	// Sets the pixels x in [lx,ux], y in [ly,uy] to color, the rectangle is clamped to the framebuffer
+	void clear(const FrameBufferAttributes& color, int lx, int ly, int ux, int uy);
+
+	// Copies the pixels x in [lx,ux], y in [ly,uy] of source, a framebuffer of the same size whose deferred
+	// clear is resolved. The rectangle is clamped to the framebuffer.
+	void copy(const FrameBuffer& source, int lx, int ly, int ux, int uy);
+
+	// Flags every tile to be cleared to color, see above. Until resolve_clear() is called, the flagged
+	// tiles that were not drawn into have undefined pixels.
+	void clear_deferred(const FrameBufferAttributes& color);
+
+	// Fills the tiles still flagged by clear_deferred(), call it before reading the pixels
+	void resolve_clear();
+
+	// Fills the flagged tiles overlapping the rectangle x in [lx,ux], y in [ly,uy]. Call it before drawing
+	// into the pixels without the rasterizer while a deferred clear may be pending.
+	void prepare(int lx, int ly, int ux, int uy);
+
+	// Fills the tile of pixel (x,y) if it is flagged, before the rasterizer draws into it
+	void prepare_tile(int x, int y)
+	{
+		uint8_t& state = tiles[(y/TILE_SIZE)*tiles_x+x/TILE_SIZE];
+		if (state != TILE_DRAWN)
+		{
+			if (state == TILE_CLEAR_PENDING)
+				fill_tile(x/TILE_SIZE,y/TILE_SIZE);
+			state = TILE_DRAWN;
+		}
+	}
+
+	// Restricts the rasterizer to the pixels x in [lx,ux], y in [ly,uy], clamped to the framebuffer.
+	// Pixels outside of the scissor rectangle are neither tested nor written.
+	void set_scissor(int lx, int ly, int ux, int uy);
+
+	// Lets the rasterizer draw into every pixel again
+	void reset_scissor() { set_scissor(0,0,w-1,h-1); }
+
+	// Bounds of the scissor rectangle, included
+	int scissor_lx() const { return scissor_box[0]; }
+	int scissor_ly() const { return scissor_box[1]; }
+	int scissor_ux() const { return scissor_box[2]; }
+	int scissor_uy() const { return scissor_box[3]; }
+
+	private:
+	// Deferred clear state of a tile
+	enum TileState
+	{
+		// The pixels were drawn into, or are unknown
+		TILE_DRAWN,
+		// The tile is clear but the pixels were not filled yet
+		TILE_CLEAR_PENDING,
+		// The pixels hold the clear color
+		TILE_CLEAR
+	};
+
+	void bind()
+	{
+		top = external ? external : reinterpret_cast<uint8_t*>(storage.data());
+		bottom = top+ptrdiff_t(h > 0 ? h-1 : 0)*stride;
+		tiles_x = (w+TILE_SIZE-1)/TILE_SIZE;
+		tiles.assign(tiles_x*((h+TILE_SIZE-1)/TILE_SIZE),uint8_t(TILE_DRAWN));
+		reset_scissor();
+	}
+
+	void fill_tile(int tx, int ty);
+
+	int w, h, stride;
+	uint8_t* external;
+	std::vector<FrameBufferAttributes> storage;
+	// Rows y = height-1 and y = 0
+	uint8_t* top;
+	uint8_t* bottom;
 
-// Contains the three shaders used by the rasterizer
-class Program
+	// TileState of the tiles, row by row from y = 0
+	int tiles_x;
+	std::vector<uint8_t> tiles;
+	FrameBufferAttributes clear_color;
+
+	// lx, ly, ux, uy
+	std::array<int,4> scissor_box;
+};
+
+// Stores the depth of the closest fragment of every pixel, same size as the FrameBuffer.
+// Clear it to infinity (or any value above 1) before drawing.
+typedef Eigen::MatrixXf DepthBuffer;
+
+// Diagnostic counters of one pixel: the fragments the rasterizer tested (coverage and depth),
+// and the fragments it shaded, i.e. passed to the fragment and blending shaders
+class OverdrawCounters
+{
+	public:
+	OverdrawCounters() : tested(0), shaded(0) {}
+
+	uint32_t tested;
+	uint32_t shaded;
+};
+
+// Per-pixel counters of the overdraw diagnostic mode, same size as the FrameBuffer
+typedef Eigen::Matrix<OverdrawCounters,Eigen::Dynamic,Eigen::Dynamic> OverdrawBuffer;
+
+// Part of a scene rasterized on its own, with the depth of its triangles. Its pixels are kept from one
+// frame to the next and composited with the other layers, so that a layer is only drawn again when its
+// content changes. The pixels are premultiplied rgba, the transparent ones let the layers below show.
+class RasterLayer
+{
+	public:
+	RasterLayer() : valid(false) {}
+	RasterLayer(int width, int height) : frameBuffer(width,height), depthBuffer(width,height), valid(false) {}
+
+	void resize(int width, int height)
+	{
+		frameBuffer.resize(width,height);
+		depthBuffer.resize(width,height);
+		valid = false;
+	}
+
+	FrameBuffer frameBuffer;
+	DepthBuffer depthBuffer;
+
+	// Whether the pixels hold the current content of the layer, the owner resets it when the content changes
+	bool valid;
+};
+
+// Spans handed to the span shaders are at most this many pixels long
+const int MAX_SPAN_LENGTH = 64;
+
+// Placeholder for a shader that a ShaderProgram does not provide. Its overloads only exist so that
+// the rasterizer compiles, they are never called.
+class NoShader
 {
 	public:
-	// Vertex Shader
-	std::function<VertexAttributes(const VertexAttributes&, const UniformAttributes&)> VertexShader;
-	// Fragment Shader
-	std::function<FragmentAttributes(const VertexAttributes&, const UniformAttributes&)> FragmentShader;
-	// Blending Shader
-	std::function<FrameBufferAttributes(const FragmentAttributes&, const FrameBufferAttributes&)> BlendingShader;
+	FragmentAttributes operator()(const VertexAttributes&, const UniformAttributes&) const { return FragmentAttributes(); }
+	FrameBufferAttributes operator()(const FragmentAttributes&, const FrameBufferAttributes&) const { return FrameBufferAttributes(); }
+	void operator()(const FragmentSpan&, const UniformAttributes&, FragmentAttributes*) const {}
+	void operator()(const FragmentSpan&, const FragmentAttributes*, FrameBufferAttributes*) const {}
+};
+
+// Contains the shaders used by the rasterizer. The shader types are template parameters:
+// with lambdas or function objects the rasterizer is compiled for these exact shaders and can inline them.
+//
+// The span shaders are an alternative to the fragment and blending shaders that process a whole
+// FragmentSpan per call. When a program provides both, they are used instead of the per-pixel shaders.
+//
+// Threading: the vertex shader runs on the calling thread. Draws of 64 triangles or more split the frame into tiles rasterized in parallel by the threads of a pool, so the fragment and
+// blending shaders, per-pixel or span, are then called concurrently and must be thread-safe: they must
+// not change state shared between calls without synchronizing it. Each call writes only the pixels it
+// is given. The RASTER_THREADS environment variable sets the number of threads, RASTER_THREADS=1 turns
+// the threading off and every shader runs on the calling thread.
+template <typename VS, typename FS, typename BS, typename SFS = NoShader, typename SBS = NoShader>
+class ShaderProgram
+{
+	public:
+	ShaderProgram() {}
+	ShaderProgram(const VS& vs, const FS& fs, const BS& bs, const SFS& sfs = SFS(), const SBS& sbs = SBS())
+		: VertexShader(vs), FragmentShader(fs), BlendingShader(bs), SpanFragmentShader(sfs), SpanBlendingShader(sbs) {}
+
+	// Vertex Shader, called as VertexAttributes(const VertexAttributes&, const UniformAttributes&)
+	VS VertexShader;
+	// Fragment Shader, called as FragmentAttributes(const VertexAttributes&, const UniformAttributes&)
+	FS FragmentShader;
+	// Blending Shader, called as FrameBufferAttributes(const FragmentAttributes&, const FrameBufferAttributes&)
+	BS BlendingShader;
+	// Span Fragment Shader, called as void(const FragmentSpan&, const UniformAttributes&, FragmentAttributes* fragments).
+	// Writes fragments[k] for every covered pixel k of the span.
+	SFS SpanFragmentShader;
+	// Span Blending Shader, called as void(const FragmentSpan&, const FragmentAttributes* fragments, FrameBufferAttributes* pixels).
+	// pixels points to the framebuffer at the first pixel of the span, the following pixels of the row are contiguous.
+	SBS SpanBlendingShader;
+};
+
+// Builds a program from three shaders, deducing their types
+template <typename VS, typename FS, typename BS>
+ShaderProgram<VS,FS,BS> make_program(const VS& vs, const FS& fs, const BS& bs)
+{
+	return ShaderProgram<VS,FS,BS>(vs,fs,bs);
+}
+
+// Builds a program that shades spans, deducing the types of the shaders
+template <typename VS, typename SFS, typename SBS>
+ShaderProgram<VS,NoShader,NoShader,SFS,SBS> make_span_program(const VS& vs, const SFS& sfs, const SBS& sbs)
+{
+	return ShaderProgram<VS,NoShader,NoShader,SFS,SBS>(vs,NoShader(),NoShader(),sfs,sbs);
+}
+
+// Span blending shader that blends the fragments into the framebuffer with one of the BlendModes.
+// Fragment colors are straight alpha in 0..1, the framebuffer holds premultiplied colors. Converting
+// and blending are vectorized.
+class SpanBlender
+{
+	public:
+	explicit SpanBlender(BlendMode mode = BLEND_SOURCE_OVER) : mode(mode) {}
+
+	void operator()(const FragmentSpan& span, const FragmentAttributes* fragments, FrameBufferAttributes* pixels) const;
+
+	BlendMode mode;
+};
+
+// Type-erased program whose shaders can be assigned at runtime. The span shaders are optional.
+// The shaders follow the threading rules of ShaderProgram: a std::function that modifies what it
+// captures races when the draw is threaded.
+class Program : public ShaderProgram<
+	std::function<VertexAttributes(const VertexAttributes&, const UniformAttributes&)>,
+	std::function<FragmentAttributes(const VertexAttributes&, const UniformAttributes&)>,
+	std::function<FrameBufferAttributes(const FragmentAttributes&, const FrameBufferAttributes&)>,
+	std::function<void(const FragmentSpan&, const UniformAttributes&, FragmentAttributes*)>,
+	std::function<void(const FragmentSpan&, const FragmentAttributes*, FrameBufferAttributes*)> >
+{
 };
 
 // Rasterizes a single triangle v1,v2,v3 using the provided program and uniforms.
@@ -26,9 +294,43 @@ class Program
 void rasterize_triangle(const Program& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, FrameBuffer& frameBuffer);
 
 // Rasterizes a collection of triangles, assembling one triangle for each 3 consecutive vertices.
-// Note: the vertices will be processed by the vertex shader
+// Note: the vertices will be processed by the vertex shader. From 64 triangles up the fragment and
+// blending shaders are called from several threads at once, see ShaderProgram.
 void rasterize_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer);
 
+// Rasterizes a single triangle, shading only the fragments closer than the depth buffer and storing their depth.
+void rasterize_triangle(const Program& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+// Rasterizes a collection of triangles with a depth test. Fragments with a smaller z are in front.
+// The depth test runs before the fragment shader: opaque triangles (alpha 1 at every vertex) are drawn
+// first from the last one to the first, so that hidden fragments are never shaded, then translucent
+// triangles from back to front without writing their depth. On equal z the last opaque triangle wins
+// as without depth buffer, and translucent triangles are blended over the opaque ones even when they
+// were submitted before them.
+void rasterize_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+// Rasterizes a collection of triangles, assembling one triangle for each 3 consecutive indices in vertices.
+// Note: the vertex shader is called once per vertex, whatever the number of triangles sharing it. The
+// fragment and blending shaders may be called from several threads at once, see ShaderProgram.
+void rasterize_indexed_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<unsigned>& indices, FrameBuffer& frameBuffer);
+
+// Rasterizes an indexed collection of triangles with a depth test, as rasterize_triangles does
+void rasterize_indexed_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<unsigned>& indices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+// Rasterizes a triangle strip: triangle i is made of vertices i, i+1 and i+2
+void rasterize_triangle_strip(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer);
+void rasterize_triangle_strip(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+// Rasterizes a triangle fan: triangle i is made of vertices 0, i+1 and i+2
+void rasterize_triangle_fan(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer);
+void rasterize_triangle_fan(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+// Rasterizes the triangles of vertices (3 consecutive vertices each) once per instance, in instance order.
+// Note: the vertex shader is called once per vertex, each instance then transforms the shaded positions and
+// multiplies the shaded colors by its own transform and color
+void rasterize_instanced_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<InstanceAttributes>& instances, FrameBuffer& frameBuffer);
+void rasterize_instanced_triangles(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<InstanceAttributes>& instances, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
 // Rasterizes a single line v1,v2 of thickness line_thickness using the provided program and uniforms.
 // Note: v1, v2 needs to be in the canonical view volume (i.e. after being processed by the vertex shader)
 void rasterize_line(const Program& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, float line_thickness, FrameBuffer& frameBuffer);
@@ -37,5 +339,70 @@ void rasterize_line(const Program& program, const UniformAttributes& uniform, co
 // Note: the vertices will be processed by the vertex shader
 void rasterize_lines(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer);
 
+// Rasterizes a polyline, with a line between every vertex and the next one
+void rasterize_line_strip(const Program& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer);
+
 // Exports the framebuffer to a uint8 raw image
-void framebuffer_to_uint8(const FrameBuffer& frameBuffer, std::vector<uint8_t>& image);
\ No newline at end of file
+void framebuffer_to_uint8(const FrameBuffer& frameBuffer, std::vector<uint8_t>& image);
+
+// Blends the pixels of the layer over the framebuffer, of the same size, within its scissor rectangle.
+// The deferred clear of the layer must be resolved.
+void composite_layer(const RasterLayer& layer, BlendMode mode, FrameBuffer& frameBuffer);
+
+// Enables the overdraw diagnostic mode: until it is reset to nullptr, every draw adds its fragments
+// to the counters of the buffer, which must have the size of the framebuffers drawn to
+void set_overdraw_buffer(OverdrawBuffer* overdraw);
+
+// Replaces the framebuffer with a false color heatmap of the shaded (or tested) fragment counts:
+// black for none, then from blue through green, yellow and red to white for 8 fragments and more
+void overdraw_to_heatmap(const OverdrawBuffer& overdraw, bool tested, FrameBuffer& frameBuffer);
+
+// The functions above are compiled once for Program. The templates below take any ShaderProgram
+// and are compiled for its shaders, so that they get inlined into the rasterization loops.
+
+template <typename... Shaders>
+void rasterize_triangle(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, FrameBuffer& frameBuffer);
+
+template <typename... Shaders>
+void rasterize_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer);
+
+template <typename... Shaders>
+void rasterize_triangle(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+template <typename... Shaders>
+void rasterize_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+template <typename... Shaders>
+void rasterize_indexed_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<unsigned>& indices, FrameBuffer& frameBuffer);
+
+template <typename... Shaders>
+void rasterize_indexed_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<unsigned>& indices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+template <typename... Shaders>
+void rasterize_triangle_strip(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer);
+
+template <typename... Shaders>
+void rasterize_triangle_strip(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+template <typename... Shaders>
+void rasterize_triangle_fan(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer);
+
+template <typename... Shaders>
+void rasterize_triangle_fan(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+template <typename... Shaders>
+void rasterize_instanced_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<InstanceAttributes>& instances, FrameBuffer& frameBuffer);
+
+template <typename... Shaders>
+void rasterize_instanced_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<InstanceAttributes>& instances, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer);
+
+template <typename... Shaders>
+void rasterize_line(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, float line_thickness, FrameBuffer& frameBuffer);
+
+template <typename... Shaders>
+void rasterize_lines(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer);
+
+template <typename... Shaders>
+void rasterize_line_strip(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer);
+
+#include "raster_impl.h"
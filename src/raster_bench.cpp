@@ -0,0 +1,401 @@
+// Benchmarks of the raster pipeline on synthetic scenes. Every case draws the same frame repeatedly and
+// reports the median time of a frame, with the triangles (or lines) and the pixels it shades per second.
+//
+//   raster_bench [--json file] [--filter text] [--quick]
+//
+// --json writes the results to a file as JSON, to compare builds. --filter only runs the cases whose
+// name contains the text. --quick runs every case for a shorter time and skips the largest scenes.
+// Build it with CMAKE_BUILD_TYPE=Release: debug builds count the heap allocations of the editor.
+
+#include "raster.h"
+#include "Editor.h"
+#include "RenderTarget.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	class BenchOptions
+	{
+		public:
+		BenchOptions() : quick(false) {}
+
+		std::string json;
+		std::string filter;
+		bool quick;
+	};
+
+	class BenchResult
+	{
+		public:
+		std::string name;
+		int width, height;
+		// Triangles or lines drawn per frame, and fragments shaded per frame
+		uint64_t primitives, pixels;
+		int iterations;
+		double ns_per_frame;
+	};
+
+	class CanvasSize
+	{
+		public:
+		int width, height;
+	};
+
+	const CanvasSize CANVAS_SIZES[] = { {256,256}, {1024,768}, {1920,1080} };
+
+	// Silences std::cout while it exists: the editor reports its modes there
+	class QuietStdout
+	{
+		public:
+		QuietStdout() : saved(std::cout.rdbuf(nullptr)) {}
+		~QuietStdout()
+		{
+			std::cout.rdbuf(saved);
+			std::cout.clear();
+		}
+
+		private:
+		std::streambuf* saved;
+	};
+
+	// Runs frame once to warm up, then until it ran at least 3 times and min_seconds in total.
+	// Returns the median time of a run in nanoseconds.
+	double time_frames(const std::function<void()>& frame, double min_seconds, int& iterations)
+	{
+		typedef std::chrono::steady_clock clock;
+		frame();
+		std::vector<double> times;
+		double total = 0;
+		while ((times.size() < 3 || total < min_seconds) && times.size() < 100000)
+		{
+			const clock::time_point start = clock::now();
+			frame();
+			const double elapsed = std::chrono::duration<double,std::nano>(clock::now() - start).count();
+			times.push_back(elapsed);
+			total += elapsed * 1e-9;
+		}
+		iterations = int(times.size());
+		std::nth_element(times.begin(), times.begin() + times.size()/2, times.end());
+		return times[times.size()/2];
+	}
+
+	// Fragments shaded by one run of draw into a w x h framebuffer, counted with the overdraw diagnostic
+	uint64_t count_shaded(const std::function<void()>& draw, int w, int h)
+	{
+		OverdrawBuffer overdraw(w,h);
+		overdraw.setConstant(OverdrawCounters());
+		set_overdraw_buffer(&overdraw);
+		draw();
+		set_overdraw_buffer(nullptr);
+		uint64_t shaded = 0;
+		for (int j = 0; j < h; ++j)
+			for (int i = 0; i < w; ++i)
+				shaded += overdraw(i,j).shaded;
+		return shaded;
+	}
+
+	VertexAttributes ndc_vertex(float x, float y, int w, int h, const Eigen::Vector4f& color)
+	{
+		VertexAttributes v(x / w * 2 - 1, y / h * 2 - 1, 0, 1);
+		v.color = color;
+		return v;
+	}
+
+	Eigen::Vector4f random_color(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> channel(0.f, 1.f);
+		return Eigen::Vector4f(channel(rng), channel(rng), channel(rng), 1);
+	}
+
+	// count triangles in a w x h canvas, each within a square of side min_size to max_size pixels
+	std::vector<VertexAttributes> random_triangles(unsigned count, float min_size, float max_size, int w, int h, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		std::vector<VertexAttributes> vertices;
+		vertices.reserve(3*count);
+		for (unsigned t = 0; t < count; ++t)
+		{
+			const float size = min_size + (max_size - min_size) * unit(rng);
+			const float x = unit(rng) * (w - size), y = unit(rng) * (h - size);
+			const Eigen::Vector4f color = random_color(rng);
+			for (int k = 0; k < 3; ++k)
+				vertices.push_back(ndc_vertex(x + unit(rng) * size, y + unit(rng) * size, w, h, color));
+		}
+		return vertices;
+	}
+
+	// count triangles covering half of the canvas each, alternating between its two halves
+	std::vector<VertexAttributes> huge_triangles(unsigned count, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::vector<VertexAttributes> vertices;
+		for (unsigned t = 0; t < count; ++t)
+		{
+			const Eigen::Vector4f color = random_color(rng);
+			const float corners[2][6] = { {-1,-1, 1,-1, 1,1}, {-1,-1, 1,1, -1,1} };
+			for (int k = 0; k < 3; ++k)
+			{
+				VertexAttributes v(corners[t % 2][2*k], corners[t % 2][2*k+1], 0, 1);
+				v.color = color;
+				vertices.push_back(v);
+			}
+		}
+		return vertices;
+	}
+
+	// count lines of 10 to 200 pixels in a w x h canvas
+	std::vector<VertexAttributes> random_lines(unsigned count, int w, int h, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		std::vector<VertexAttributes> vertices;
+		vertices.reserve(2*count);
+		for (unsigned l = 0; l < count; ++l)
+		{
+			const float length = 10 + 190 * unit(rng), angle = 6.2831853f * unit(rng);
+			const float x = unit(rng) * w, y = unit(rng) * h;
+			const Eigen::Vector4f color = random_color(rng);
+			vertices.push_back(ndc_vertex(x, y, w, h, color));
+			vertices.push_back(ndc_vertex(x + length * std::cos(angle), y + length * std::sin(angle), w, h, color));
+		}
+		return vertices;
+	}
+
+	class Bench
+	{
+		public:
+		explicit Bench(const BenchOptions& options) : options(options) {}
+
+		bool enabled(const std::string& name) const
+		{
+			return options.filter.empty() || name.find(options.filter) != std::string::npos;
+		}
+
+		// Times frame, reporting the pixels returned by pixels_per_frame, by default the fragments frame shades
+		void run(const std::string& name, int w, int h, uint64_t primitives, const std::function<void()>& frame, const std::function<uint64_t()>& pixels_per_frame = nullptr)
+		{
+			if (!enabled(name))
+				return;
+			BenchResult result;
+			result.name = name;
+			result.width = w;
+			result.height = h;
+			result.primitives = primitives;
+			result.pixels = pixels_per_frame ? pixels_per_frame() : count_shaded(frame, w, h);
+			result.ns_per_frame = time_frames(frame, options.quick ? 0.05 : 0.5, result.iterations);
+			results.push_back(result);
+
+			std::printf("%-40s %5dx%-5d %14.0f ns/frame %10.3f Mtris/s %10.2f Mpix/s\n", name.c_str(), w, h,
+				result.ns_per_frame, primitives * 1e3 / result.ns_per_frame, result.pixels * 1e3 / result.ns_per_frame);
+			std::fflush(stdout);
+		}
+
+		bool write_json(const std::string& path) const
+		{
+			std::ofstream out(path.c_str());
+			out << "{\n  \"threads\": " << ThreadPool::shared().concurrency() << ",\n  \"benchmarks\": [\n";
+			for (size_t i = 0; i < results.size(); ++i)
+			{
+				const BenchResult& r = results[i];
+				char line[512];
+				std::snprintf(line, sizeof(line),
+					"    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"primitives\": %llu, \"pixels\": %llu, "
+					"\"iterations\": %d, \"ns_per_frame\": %.0f, \"mtris_per_s\": %.4f, \"mpix_per_s\": %.4f}%s\n",
+					r.name.c_str(), r.width, r.height, (unsigned long long)r.primitives, (unsigned long long)r.pixels,
+					r.iterations, r.ns_per_frame, r.primitives * 1e3 / r.ns_per_frame, r.pixels * 1e3 / r.ns_per_frame,
+					i + 1 < results.size() ? "," : "");
+				out << line;
+			}
+			out << "  ]\n}\n";
+			return bool(out);
+		}
+
+		const BenchOptions options;
+		std::vector<BenchResult> results;
+	};
+
+	std::string count_name(unsigned count)
+	{
+		return count >= 1000000 ? std::to_string(count / 1000000) + "M" : std::to_string(count / 1000) + "k";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	BenchOptions options;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			options.json = argv[++i];
+		else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			options.filter = argv[++i];
+		else if (std::strcmp(argv[i], "--quick") == 0)
+			options.quick = true;
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--json file] [--filter text] [--quick]" << std::endl;
+			return 1;
+		}
+	}
+	Bench bench(options);
+
+	// Program of the editor: identity vertex shader, interpolated colors blended over the framebuffer
+	UniformAttributes uniform;
+	auto vertexShader = [](const VertexAttributes& va, const UniformAttributes&) { return va; };
+	auto spanFragmentShader = [](const FragmentSpan& span, const UniformAttributes&, FragmentAttributes* fragments)
+	{
+		Eigen::Vector4f color = span.start.color;
+		for (int k = 0; k < span.count; k++)
+		{
+			fragments[k].color = color;
+			color += span.dx.color;
+		}
+	};
+	auto program = make_span_program(vertexShader, spanFragmentShader, SpanBlender(BLEND_SOURCE_OVER));
+
+	const unsigned largest = options.quick ? 100000 : 1000000;
+
+	// Single triangles, tiny and huge, for every canvas size
+	for (const CanvasSize& canvas : CANVAS_SIZES)
+	{
+		const int w = canvas.width, h = canvas.height;
+		FrameBuffer frameBuffer(w,h);
+		const std::vector<VertexAttributes> tiny = random_triangles(10000, 1, 3, w, h, 1);
+		const std::vector<VertexAttributes> huge = huge_triangles(16, 2);
+		bench.run("rasterize_triangle/tiny/10k", w, h, tiny.size()/3, [&]() {
+			for (size_t i = 0; i + 2 < tiny.size(); i += 3)
+				rasterize_triangle(program, uniform, tiny[i], tiny[i+1], tiny[i+2], frameBuffer);
+		});
+		bench.run("rasterize_triangle/huge/16", w, h, huge.size()/3, [&]() {
+			for (size_t i = 0; i + 2 < huge.size(); i += 3)
+				rasterize_triangle(program, uniform, huge[i], huge[i+1], huge[i+2], frameBuffer);
+		});
+	}
+
+	// Batches of 1k to 1M triangles of 2 to 40 pixels, with and without depth buffer
+	for (unsigned count = 1000; count <= largest; count *= 10)
+	{
+		const int w = 1024, h = 768;
+		FrameBuffer frameBuffer(w,h);
+		DepthBuffer depthBuffer(w,h);
+		const std::vector<VertexAttributes> triangles = random_triangles(count, 2, 40, w, h, 3);
+		bench.run("rasterize_triangles/" + count_name(count), w, h, count, [&]() {
+			rasterize_triangles(program, uniform, triangles, frameBuffer);
+		});
+		bench.run("rasterize_triangles/depth/" + count_name(count), w, h, count, [&]() {
+			depthBuffer.setConstant(std::numeric_limits<float>::infinity());
+			rasterize_triangles(program, uniform, triangles, frameBuffer, depthBuffer);
+		});
+	}
+
+	// The same per-pixel shaders called through std::function by the generic program, as in the original
+	// rasterizer, and inlined by a ShaderProgram
+	{
+		const int w = 256, h = 256;
+		FrameBuffer frameBuffer(w,h);
+		auto fragmentShader = [](const VertexAttributes& va, const UniformAttributes&) { return FragmentAttributes(va.color[0], va.color[1], va.color[2]); };
+		auto blendingShader = [](const FragmentAttributes& fa, const FrameBufferAttributes&)
+		{
+			return FrameBufferAttributes(fa.color[0]*255, fa.color[1]*255, fa.color[2]*255, fa.color[3]*255);
+		};
+		Program functionProgram;
+		functionProgram.VertexShader = vertexShader;
+		functionProgram.FragmentShader = fragmentShader;
+		functionProgram.BlendingShader = blendingShader;
+		auto templateProgram = make_program(vertexShader, fragmentShader, blendingShader);
+		const std::vector<VertexAttributes> triangles = random_triangles(3000, 2, 40, w, h, 3);
+		bench.run("program/function/3k", w, h, 3000, [&]() {
+			rasterize_triangles(functionProgram, uniform, triangles, frameBuffer);
+		});
+		bench.run("program/template/3k", w, h, 3000, [&]() {
+			rasterize_triangles(templateProgram, uniform, triangles, frameBuffer);
+		});
+	}
+
+	// Thin and thick lines
+	{
+		const int w = 1024, h = 768;
+		FrameBuffer frameBuffer(w,h);
+		const std::vector<VertexAttributes> lines = random_lines(10000, w, h, 4);
+		const float thickness[2] = { 1, 8 };
+		const char* names[2] = { "rasterize_line/thin/10k", "rasterize_line/thick/10k" };
+		for (int t = 0; t < 2; ++t)
+		{
+			bench.run(names[t], w, h, lines.size()/2, [&]() {
+				for (size_t i = 0; i + 1 < lines.size(); i += 2)
+					rasterize_line(program, uniform, lines[i], lines[i+1], thickness[t], frameBuffer);
+			});
+		}
+	}
+
+	// Export of the framebuffer, for every canvas size
+	for (const CanvasSize& canvas : CANVAS_SIZES)
+	{
+		FrameBuffer frameBuffer(canvas.width, canvas.height);
+		std::vector<uint8_t> image;
+		bench.run("framebuffer_to_uint8", canvas.width, canvas.height, 0, [&]() {
+			framebuffer_to_uint8(frameBuffer, image);
+		}, [&]() { return uint64_t(canvas.width) * canvas.height; });
+	}
+
+	// Picking a position outside of every triangle, which tests all of them
+	for (unsigned count = 1000; count <= largest; count *= 10)
+	{
+		std::vector<VertexAttributes> triangles = random_triangles(count, 2, 40, 500, 500, 5);
+		UniformAttributes pickUniform;
+		pickUniform.view.setIdentity();
+		pickUniform.translate.setIdentity();
+		pickUniform.rotate.setIdentity();
+		pickUniform.scale.setIdentity();
+		bench.run("picking/miss/" + count_name(count), 500, 500, count, [&]() {
+			if (getSelectedTriangleIndex(triangles, pickUniform, 2.0, 2.0) >= 0)
+				std::abort();
+		}, []() { return uint64_t(0); });
+	}
+
+	// Frames of the editor drawn into memory: steady frames redraw an unchanged scene, full frames pan the view
+	// back and forth so that every triangle moves
+	for (unsigned count = 1000; count <= largest / 10; count *= 10)
+	{
+		const int w = 500, h = 500;
+		const std::string steady = "redraw/steady/" + count_name(count), full = "redraw/full/" + count_name(count);
+		if (!bench.enabled(steady) && !bench.enabled(full))
+			continue;
+
+		QuietStdout quiet;
+		Editor editor(w,h);
+		OffscreenTarget target(w,h);
+		editor.setTriangles(random_triangles(count, 2, 40, w, h, 6));
+		editor.draw(target);
+		bench.run(steady, w, h, count, [&]() {
+			editor.draw(target);
+		});
+		bool down = true;
+		bench.run(full, w, h, count, [&]() {
+			editor.keyPressed(down ? 'w' : 's');
+			down = !down;
+			editor.draw(target);
+		});
+	}
+
+	if (!options.json.empty() && !bench.write_json(options.json))
+	{
+		std::cerr << "could not write " << options.json << std::endl;
+		return 1;
+	}
+	return 0;
+}
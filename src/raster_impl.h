@@ -0,0 +1,976 @@
+#pragma once
+
+// Template implementation of the rasterizer, included by raster.h. The shaders are called
+// through the program type, so ShaderProgram instantiations inline them into the loops below.
+
+#include "raster_simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace raster_detail
+{
+	// Side of the square screen tiles used for binning. Rows are always rasterized in segments
+	// aligned to this grid, so binned and direct rendering produce bit identical results.
+	// They are the tiles of the deferred clear of the framebuffer.
+	const int TILE_SIZE = FrameBuffer::TILE_SIZE;
+
+	// Side of the square blocks classified against the edge functions before per-pixel work
+	const int BLOCK_SIZE = 8;
+
+	// Vertex positions are snapped to fixed point with this many fractional bits (24.8)
+	const int SUBPIXEL_BITS = 8;
+	const int64_t SUBPIXEL_SCALE = int64_t(1) << SUBPIXEL_BITS;
+
+	// Largest vertex coordinate, in pixels, for which the fixed point edge functions cannot overflow
+	const float MAX_COORDINATE = float(1 << 22);
+
+	// Relative error allowed for the depth when a whole block is rejected or accepted. It covers
+	// the rounding difference between the corner evaluation and the stepped per-pixel values, so
+	// block classification never changes the coverage.
+	const float BLOCK_EPSILON = 1e-4f;
+
+	// Triangles whose vertices all lie within this multiple of the viewport are rasterized without
+	// clipping, the others are clipped to the viewport. It keeps the vertices well within the
+	// range of the fixed point setup.
+	const float GUARD_BAND = 4;
+
+	// Vertices with a smaller w are behind the viewer, triangles are clipped to the plane w = W_NEAR
+	const float W_NEAR = 1e-5f;
+
+	// Minimum number of triangles for which binning and threading pay off
+	const unsigned BINNING_THRESHOLD = 64;
+
+	// How the vertices of a triangle draw are assembled into triangles
+	enum Topology { TRIANGLE_LIST, TRIANGLE_STRIP, TRIANGLE_FAN };
+
+	// Number of triangles assembled from n vertices
+	inline unsigned triangle_count(Topology topology, unsigned n)
+	{
+		if (topology == TRIANGLE_LIST)
+			return n/3;
+		return n >= 3 ? n-2 : 0;
+	}
+
+	// Indices of the vertices of triangle t
+	inline void triangle_vertices(Topology topology, unsigned t, unsigned index[3])
+	{
+		switch (topology)
+		{
+		case TRIANGLE_LIST:
+			index[0] = t*3+0; index[1] = t*3+1; index[2] = t*3+2;
+			break;
+		case TRIANGLE_STRIP:
+			// Every other triangle is flipped, so that they all keep the winding of the first one
+			index[0] = t; index[1] = t+1+(t&1); index[2] = t+2-(t&1);
+			break;
+		case TRIANGLE_FAN:
+			index[0] = 0; index[1] = t+1; index[2] = t+2;
+			break;
+		}
+	}
+
+	// Classification of a block of pixels against a triangle
+	enum BlockCoverage { BLOCK_OUTSIDE, BLOCK_PARTIAL, BLOCK_INSIDE };
+
+	// Rectangle of pixels, bounds included
+	struct PixelRect
+	{
+		int lx, ly, ux, uy;
+	};
+
+	// A triangle after setup: its edge functions, attribute increments and bounding box
+	struct TriangleSetup
+	{
+		// Counterclockwise, the setup swaps the last two vertices of clockwise triangles
+		const VertexAttributes* v[3];
+
+		// Fixed point edge functions at the center of pixel (i,j): e_k = A[k]*i + B[k]*j + C[k].
+		// e_k is opposite to vertex k and positive inside the triangle.
+		int64_t A[3], B[3], C[3];
+		// -1 for the edges that are neither top nor left, to exclude the pixel centers lying on them
+		int64_t bias[3];
+		// Inverse of twice the area, to turn the edge functions into barycentric coordinates
+		double inv_area;
+
+		Eigen::Vector4f position_dx;
+		Eigen::Vector4f position_dy;
+		Eigen::Vector4f color_dx;
+		PixelRect box;
+
+		// Tolerance of the depth for block classification
+		float z_epsilon;
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+	// Triangles sorted into screen tiles: the indices binned in tile t are items[offset[t]..offset[t+1]),
+	// in submission order
+	struct TileBins
+	{
+		int tiles_x, tiles_y;
+		std::vector<unsigned> offset;
+		std::vector<unsigned> items;
+		// Next free item of every tile, while binning
+		std::vector<unsigned> fill;
+	};
+
+	// Fragments counted for the pipeline statistics
+	struct FragmentCounts
+	{
+		uint64_t tested;
+		uint64_t shaded;
+	};
+
+	// Adds the fragments counted by a draw to the statistics
+	inline void add_fragment_counts(FrameStats* stats, const FragmentCounts& counts)
+	{
+		stats->pixels_tested += counts.tested;
+		stats->pixels_shaded += counts.shaded;
+	}
+
+	// Adds the triangles of a draw, and the ones dropped by clipping, to the statistics if they are enabled
+	inline void add_submitted(unsigned submitted, unsigned culled)
+	{
+		if (FrameStats* stats = frame_stats())
+		{
+			stats->triangles_submitted += submitted;
+			stats->triangles_culled += culled;
+		}
+	}
+
+	// Working memory of the draw calls. It is kept from one call to the next, so that once it has
+	// grown to the size of the scene, drawing does not allocate anymore. Every thread has its own.
+	struct DrawScratch
+	{
+		// Vertices after the vertex shader, followed by the ones created by clipping
+		std::vector<VertexAttributes> v;
+		// Vertices after the vertex shader, before instancing
+		std::vector<VertexAttributes> shaded;
+		// Clipped triangles, three indices in v per triangle
+		std::vector<unsigned> triangles;
+		// Drawing order of the triangles
+		std::vector<unsigned> order;
+		std::vector<TriangleSetup,Eigen::aligned_allocator<TriangleSetup> > setups;
+		TileBins bins;
+		// Fragments counted in every tile, while the statistics are enabled
+		std::vector<FragmentCounts> tile_counts;
+	};
+
+	// Scratch memory of the calling thread
+	DrawScratch& draw_scratch();
+
+	// Clips the triangle made of vertices a, b and c of v, after the vertex shader. Triangles within the
+	// guard band are appended to triangles as they are. Triangles crossing it are clipped to the
+	// viewport and the near plane, the vertices they gain are appended to v. Triangles entirely
+	// outside of the view volume are dropped.
+	void clip_triangle(std::vector<VertexAttributes>& v, unsigned a, unsigned b, unsigned c, std::vector<unsigned>& triangles);
+
+	// Prepares a triangle for rasterization, returns false if it does not cover the framebuffer
+	bool setup_triangle(const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, int width, int height, TriangleSetup& setup);
+
+	// Classifies the pixel centers of the rectangle against the triangle and the bi-unit cube
+	BlockCoverage classify_block(const TriangleSetup& setup, int lx, int ly, int ux, int uy);
+
+	// Bins the bounding boxes of the triangles into the tiles of a width x height framebuffer
+	void bin_triangles(const std::vector<TriangleSetup,Eigen::aligned_allocator<TriangleSetup> >& setups, int width, int height, TileBins& bins);
+
+	// Returns the pixels of tile t
+	PixelRect tile_rect(const TileBins& bins, int t, int width, int height);
+
+	// Returns the scissor rectangle of the framebuffer
+	inline PixelRect scissor_rect(const FrameBuffer& frameBuffer)
+	{
+		const PixelRect rect = {frameBuffer.scissor_lx(), frameBuffer.scissor_ly(), frameBuffer.scissor_ux(), frameBuffer.scissor_uy()};
+		return rect;
+	}
+
+	// Range of x where the horizontal line at height y is within distance r of the segment l1,l2.
+	// Returns false if it does not intersect the capsule.
+	bool capsule_row(const Eigen::Vector2f& l1, const Eigen::Vector2f& l2, float r, float y, float& x0, float& x1);
+
+	// Value of edge function k at the center of pixel (i,j), without the top-left bias
+	inline int64_t edge_function(const TriangleSetup& setup, int k, int i, int j)
+	{
+		return setup.A[k]*i + setup.B[k]*j + setup.C[k];
+	}
+
+	// Barycentric coordinates of the center of pixel (i,j)
+	inline Eigen::Vector3f barycentric(const TriangleSetup& setup, int i, int j)
+	{
+		return Eigen::Vector3f(
+			float(edge_function(setup,0,i,j)*setup.inv_area),
+			float(edge_function(setup,1,i,j)*setup.inv_area),
+			float(edge_function(setup,2,i,j)*setup.inv_area));
+	}
+
+	// Interpolated attributes at the center of pixel (i,j). They are expressed relative to the first
+	// vertex, so that attributes which are constant over the triangle (typically the depth) are exact.
+	inline void interpolate(const TriangleSetup& setup, int i, int j, VertexAttributes& va)
+	{
+		const Eigen::Vector3f b = barycentric(setup,i,j);
+		const VertexAttributes& v1 = *setup.v[0];
+		const VertexAttributes& v2 = *setup.v[1];
+		const VertexAttributes& v3 = *setup.v[2];
+		va.position = v1.position + b[1]*(v2.position-v1.position) + b[2]*(v3.position-v1.position);
+		va.color = v1.color + b[1]*(v2.color-v1.color) + b[2]*(v3.color-v1.color);
+	}
+
+	// Whether a shader is present: NoShader never is, std::function when it is set
+	template <typename S>
+	inline bool shader_provided(const S&) { return true; }
+	inline bool shader_provided(const NoShader&) { return false; }
+	template <typename F>
+	inline bool shader_provided(const std::function<F>& shader) { return bool(shader); }
+
+	// Whether the program shades spans rather than single pixels
+	template <typename P>
+	inline bool uses_span_shaders(const P& program)
+	{
+		return shader_provided(program.SpanFragmentShader) && shader_provided(program.SpanBlendingShader);
+	}
+
+	// Shades a span of at most MAX_SPAN_LENGTH pixels with the span shaders
+	template <typename P>
+	inline void shade_span(const P& program, const UniformAttributes& uniform, const FragmentSpan& span, FrameBuffer& frameBuffer)
+	{
+		FragmentAttributes fragments[MAX_SPAN_LENGTH];
+		program.SpanFragmentShader(span,uniform,fragments);
+		program.SpanBlendingShader(span,fragments,&frameBuffer(span.x,span.y));
+	}
+
+	// Shades one covered pixel
+	template <typename P>
+	inline void shade_pixel(const P& program, const UniformAttributes& uniform, const VertexAttributes& va, int i, int j, FrameBuffer& frameBuffer)
+	{
+		FragmentAttributes frag = program.FragmentShader(va,uniform);
+		frameBuffer(i,j) = program.BlendingShader(frag,frameBuffer(i,j));
+	}
+
+	// Counters of the overdraw diagnostic mode, null when it is disabled
+	OverdrawBuffer*& overdraw_buffer();
+
+	// Adds count pixels of row j starting at x to the overdraw counters and to the fragment counts,
+	// either of them may be null. The pixels set in the mask (all of them if it is null) were shaded.
+	inline void count_fragments(OverdrawBuffer* overdraw, FragmentCounts* counts, int x, int j, int count, const uint8_t* mask)
+	{
+		if (counts)
+		{
+			counts->tested += count;
+			if (!mask)
+				counts->shaded += count;
+			else
+				for (int k=0; k<count; k++)
+					counts->shaded += mask[k] != 0;
+		}
+		if (!overdraw)
+			return;
+		OverdrawCounters* counters = &(*overdraw)(x,j);
+		for (int k=0; k<count; k++)
+		{
+			counters[k].tested++;
+			counters[k].shaded += !mask || mask[k];
+		}
+	}
+
+	// Depth test of a draw, disabled when buffer is null
+	struct DepthTest
+	{
+		DepthBuffer* buffer;
+		// Whether the fragments that pass store their depth
+		bool write;
+	};
+
+	// Early depth test of the fragment of pixel (x,j) whose depth is z. Returns whether it is in front
+	// of the depth buffer, or at the same depth for a test that does not write it: translucent fragments
+	// blend over the opaque surface they lie on.
+	inline bool depth_test(const DepthTest& depth, int x, int j, float z)
+	{
+		float& stored = (*depth.buffer)(x,j);
+		if (!(depth.write ? z < stored : z <= stored))
+			return false;
+		if (depth.write)
+			stored = z;
+		return true;
+	}
+
+	// Early depth test of count pixels of row j starting at x, whose depth is z[k]. Clears the mask
+	// of the fragments that are not in front of the depth buffer, returns the number of the others.
+	inline int depth_test(const DepthTest& depth, int x, int j, int count, const float* z, uint8_t* mask)
+	{
+		int passed = 0;
+		for (int k=0; k<count; k++)
+		{
+			if (mask[k] && depth_test(depth,x+k,j,z[k]))
+				passed++;
+			else
+				mask[k] = 0;
+		}
+		return passed;
+	}
+
+	// Rasterizes the pixels of a triangle that lie within the scissor rectangle, counting its fragments
+	// into counts unless it is null
+	template <typename P>
+	void rasterize_setup(const P& program, const UniformAttributes& uniform, const TriangleSetup& setup, const PixelRect& scissor, const DepthTest& depth, FragmentCounts* counts, FrameBuffer& frameBuffer)
+	{
+		const int lx = std::max(setup.box.lx,scissor.lx);
+		const int ly = std::max(setup.box.ly,scissor.ly);
+		const int ux = std::min(setup.box.ux,scissor.ux);
+		const int uy = std::min(setup.box.uy,scissor.uy);
+
+		// Coverage of partially covered pixels is computed for the span shaders by the widest kernel the CPU supports
+		const RowKernel kernel = row_kernel();
+		uint8_t mask[TILE_SIZE];
+		float depths[TILE_SIZE];
+		BlockCoverage blocks[TILE_SIZE/BLOCK_SIZE];
+
+		OverdrawBuffer* overdraw = overdraw_buffer();
+
+		// Span shaders receive whole runs of blocks, with the attributes at the first pixel
+		const bool spans = uses_span_shaders(program);
+		FragmentSpan span;
+		span.dx.position = setup.position_dx;
+		span.dx.color = setup.color_dx;
+
+		RasterRow row;
+		for (int k=0; k<3; k++)
+			row.e_dx[k] = setup.A[k];
+		row.z_dx = setup.position_dx[2];
+
+		// Rasterize the triangle one band of blocks at a time, and within a band one row at a time
+		// to walk the framebuffer in memory order
+		VertexAttributes va;
+		for (int band=ly; band<=uy; band=(band/BLOCK_SIZE+1)*BLOCK_SIZE)
+		{
+			const int band_end = std::min(uy,(band/BLOCK_SIZE+1)*BLOCK_SIZE-1);
+
+			for (int x0=lx; x0<=ux; x0=(x0/TILE_SIZE+1)*TILE_SIZE)
+			{
+				const int x1 = std::min(ux,(x0/TILE_SIZE+1)*TILE_SIZE-1);
+
+				// Classify the blocks of the band within this tile segment
+				int n_blocks = 0;
+				bool any = false;
+				for (int bx=x0; bx<=x1; bx=(bx/BLOCK_SIZE+1)*BLOCK_SIZE)
+				{
+					blocks[n_blocks] = classify_block(setup,bx,band,std::min(x1,(bx/BLOCK_SIZE+1)*BLOCK_SIZE-1),band_end);
+					any = any || blocks[n_blocks] != BLOCK_OUTSIDE;
+					n_blocks++;
+				}
+				if (!any)
+					continue;
+				frameBuffer.prepare_tile(x0,band);
+
+				for (int j=band; j<=band_end; j++)
+				{
+					// Process runs of consecutive blocks with the same classification
+					for (int first=0, last=0; first<n_blocks; first=last)
+					{
+						for (last=first+1; last<n_blocks && blocks[last] == blocks[first]; last++);
+						if (blocks[first] == BLOCK_OUTSIDE)
+							continue;
+
+						const int start = std::max(x0,(x0/BLOCK_SIZE+first)*BLOCK_SIZE);
+						const int end = std::min(x1,(x0/BLOCK_SIZE+last)*BLOCK_SIZE-1);
+						const int count = end-start+1;
+
+						if (blocks[first] == BLOCK_INSIDE)
+						{
+							// Every pixel is covered, step the attributes without edge tests
+							interpolate(setup,start,j,va);
+
+							// Only the depth test can discard fragments
+							const uint8_t* run_mask = nullptr;
+							if (depth.buffer)
+							{
+								float z = va.position[2];
+								for (int k=0; k<count; k++)
+								{
+									depths[k] = z;
+									mask[k] = 0xFF;
+									z += setup.position_dx[2];
+								}
+								const int passed = depth_test(depth,start,j,count,depths,mask);
+								count_fragments(overdraw,counts,start,j,count,mask);
+								if (passed == 0)
+									continue;
+								run_mask = mask;
+							}
+							else
+								count_fragments(overdraw,counts,start,j,count,nullptr);
+
+							if (spans)
+							{
+								span.x = start;
+								span.y = j;
+								span.count = count;
+								span.mask = run_mask;
+								span.start = va;
+								shade_span(program,uniform,span,frameBuffer);
+								continue;
+							}
+
+							for (int i=start; i<=end; i++)
+							{
+								if (!run_mask || run_mask[i-start])
+									shade_pixel(program,uniform,va,i,j,frameBuffer);
+								va.position += setup.position_dx;
+								va.color += setup.color_dx;
+							}
+							continue;
+						}
+
+						for (int k=0; k<3; k++)
+							row.e[k] = edge_function(setup,k,start,j) + setup.bias[k];
+						interpolate(setup,start,j,va);
+
+						if (!spans)
+						{
+							// Per-pixel shaders take the attributes one pixel at a time: the exact edge functions
+							// and the attributes are stepped along the row with the shading, a separate vector
+							// coverage pass would cost more than it saves
+							int64_t e0 = row.e[0], e1 = row.e[1], e2 = row.e[2];
+							for (int k=0; k<count; k++)
+							{
+								// Inside the triangle (no edge function is negative) and within the bi-unit cube
+								bool inside = (e0 | e1 | e2) >= 0 && va.position[2] >= -1 && va.position[2] <= 1;
+								if (inside && depth.buffer)
+									inside = depth_test(depth,start+k,j,va.position[2]);
+								mask[k] = inside ? 0xFF : 0;
+								if (inside)
+									shade_pixel(program,uniform,va,start+k,j,frameBuffer);
+								va.position += setup.position_dx;
+								va.color += setup.color_dx;
+								e0 += setup.A[0];
+								e1 += setup.A[1];
+								e2 += setup.A[2];
+							}
+							count_fragments(overdraw,counts,start,j,count,mask);
+							continue;
+						}
+
+						// The span shaders interpolate by themselves, only the mask (and the depth) is needed
+						row.z = va.position[2];
+						int covered = kernel(row,count,mask,depth.buffer ? depths : nullptr);
+						if (depth.buffer && covered > 0)
+							covered = depth_test(depth,start,j,count,depths,mask);
+						count_fragments(overdraw,counts,start,j,count,mask);
+						if (covered == 0)
+							continue;
+
+						span.x = start;
+						span.y = j;
+						span.count = count;
+						span.mask = mask;
+						span.start = va;
+						shade_span(program,uniform,span,frameBuffer);
+					}
+				}
+			}
+		}
+	}
+
+	// Sets up and rasterizes a triangle, timing both with clock. Returns false if it does not cover any
+	// pixel of the scissor rectangle.
+	template <typename P>
+	bool rasterize_triangle(const P& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, const DepthTest& depth, FragmentCounts* counts, StageClock& clock, FrameBuffer& frameBuffer)
+	{
+		TriangleSetup setup;
+		const PixelRect scissor = scissor_rect(frameBuffer);
+		const bool visible = setup_triangle(v1,v2,v3,frameBuffer.rows(),frameBuffer.cols(),setup)
+			&& setup.box.lx <= scissor.ux && setup.box.ux >= scissor.lx && setup.box.ly <= scissor.uy && setup.box.uy >= scissor.ly;
+		clock.lap(STAGE_SETUP);
+		if (!visible)
+			return false;
+		rasterize_setup(program,uniform,setup,scissor,depth,counts,frameBuffer);
+		clock.lap(STAGE_RASTER);
+		return true;
+	}
+
+	// Draws a single triangle, after the vertex shader, and adds it to the statistics
+	template <typename P>
+	void rasterize_single_triangle(const P& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, const DepthTest& depth, FrameBuffer& frameBuffer)
+	{
+		StageClock clock;
+		FrameStats* stats = frame_stats();
+		FragmentCounts counts = {0,0};
+		const bool visible = rasterize_triangle(program,uniform,v1,v2,v3,depth,stats ? &counts : nullptr,clock,frameBuffer);
+		if (stats)
+		{
+			stats->triangles_submitted++;
+			stats->triangles_culled += !visible;
+			add_fragment_counts(stats,counts);
+		}
+	}
+
+	// Sorts the clipped triangles in drawing order. Without depth buffer it is submission order.
+	// With a depth buffer, opaque triangles come first from the last to the first: on equal depth the
+	// first drawn wins, as the last submitted one does without depth buffer. They are followed by
+	// the translucent triangles from back to front, which pass the depth test on equal depth. Returns the number of opaque triangles.
+	unsigned depth_order(const std::vector<VertexAttributes>& v, const std::vector<unsigned>& triangles, bool depth, std::vector<unsigned>& order);
+
+	// Orders and rasterizes the clipped triangles, three indices in v per triangle. The setup and the
+	// rasterization are timed with clock.
+	template <typename P>
+	void rasterize_clipped(const P& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& v, const std::vector<unsigned>& triangles, DepthBuffer* depthBuffer, StageClock& clock, FrameBuffer& frameBuffer)
+	{
+		FrameStats* stats = frame_stats();
+		DrawScratch& scratch = draw_scratch();
+		std::vector<unsigned>& order = scratch.order;
+		const unsigned opaque = depth_order(v,triangles,depthBuffer != nullptr,order);
+
+		// Opaque triangles write their depth, translucent ones only test it
+		const DepthTest write = {depthBuffer, true};
+		const DepthTest test = {depthBuffer, false};
+
+		const unsigned n = order.size();
+		ThreadPool& pool = ThreadPool::shared();
+		if (pool.concurrency() == 1 || n < BINNING_THRESHOLD)
+		{
+			// Call the rasterization function on every triangle
+			FragmentCounts counts = {0,0};
+			unsigned culled = 0;
+			for (unsigned i=0; i<n; i++)
+			{
+				const unsigned* t = &triangles[order[i]*3];
+				culled += !rasterize_triangle(program,uniform,v[t[0]],v[t[1]],v[t[2]],i < opaque ? write : test,stats ? &counts : nullptr,clock,frameBuffer);
+			}
+			if (stats)
+			{
+				stats->triangles_culled += culled;
+				add_fragment_counts(stats,counts);
+			}
+			return;
+		}
+
+		// Set up every triangle once, they are shared by all the tiles they overlap. Their boxes are cut
+		// to the scissor rectangle, so that only the tiles within it are binned and drawn.
+		const int width = frameBuffer.rows();
+		const int height = frameBuffer.cols();
+		const PixelRect scissor = scissor_rect(frameBuffer);
+		std::vector<TriangleSetup,Eigen::aligned_allocator<TriangleSetup> >& setups = scratch.setups;
+		setups.clear();
+		unsigned opaque_setups = 0;
+		unsigned culled = 0;
+		for (unsigned i=0; i<n; i++)
+		{
+			const unsigned* t = &triangles[order[i]*3];
+			TriangleSetup setup;
+			if (setup_triangle(v[t[0]],v[t[1]],v[t[2]],width,height,setup))
+			{
+				setup.box.lx = std::max(setup.box.lx,scissor.lx);
+				setup.box.ly = std::max(setup.box.ly,scissor.ly);
+				setup.box.ux = std::min(setup.box.ux,scissor.ux);
+				setup.box.uy = std::min(setup.box.uy,scissor.uy);
+				if (setup.box.lx > setup.box.ux || setup.box.ly > setup.box.uy)
+				{
+					culled++;
+					continue;
+				}
+				setups.push_back(setup);
+				opaque_setups += i < opaque;
+			}
+			else
+				culled++;
+		}
+
+		TileBins& bins = scratch.bins;
+		bin_triangles(setups,width,height,bins);
+		clock.lap(STAGE_SETUP);
+
+		// Tiles own disjoint pixels, so they can be rasterized in parallel. Each one counts its own fragments.
+		std::vector<FragmentCounts>& tile_counts = scratch.tile_counts;
+		const FragmentCounts no_counts = {0,0};
+		if (stats)
+			tile_counts.assign(bins.tiles_x*bins.tiles_y,no_counts);
+		auto rasterize_tile = [&](int t)
+		{
+			const PixelRect scissor = tile_rect(bins,t,width,height);
+			for (unsigned k=bins.offset[t]; k<bins.offset[t+1]; k++)
+				rasterize_setup(program,uniform,setups[bins.items[k]],scissor,bins.items[k] < opaque_setups ? write : test,stats ? &tile_counts[t] : nullptr,frameBuffer);
+		};
+		// Passed by reference: std::function would copy the lambda and its captures to the heap
+		pool.run(bins.tiles_x*bins.tiles_y,std::cref(rasterize_tile));
+		clock.lap(STAGE_RASTER);
+
+		if (stats)
+		{
+			stats->triangles_culled += culled;
+			for (size_t t=0; t<tile_counts.size(); t++)
+				add_fragment_counts(stats,tile_counts[t]);
+		}
+	}
+
+	template <typename P>
+	void rasterize_triangles(const P& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, Topology topology, DepthBuffer* depthBuffer, FrameBuffer& frameBuffer)
+	{
+		// Call vertex shader on all vertices
+		StageClock clock;
+		DrawScratch& scratch = draw_scratch();
+		std::vector<VertexAttributes>& v = scratch.v;
+		v.resize(vertices.size());
+		for (unsigned i=0; i<vertices.size();i++)
+			v[i] = program.VertexShader(vertices[i],uniform);
+		clock.lap(STAGE_VERTEX);
+
+		// Clip the triangles, three vertex indices per triangle in submission order
+		std::vector<unsigned>& triangles = scratch.triangles;
+		triangles.clear();
+		const unsigned n = triangle_count(topology,vertices.size());
+		unsigned culled = 0;
+		for (unsigned i=0; i<n; i++)
+		{
+			unsigned t[3];
+			triangle_vertices(topology,i,t);
+			const size_t clipped = triangles.size();
+			clip_triangle(v,t[0],t[1],t[2],triangles);
+			culled += triangles.size() == clipped;
+		}
+		add_submitted(n,culled);
+
+		rasterize_clipped(program,uniform,v,triangles,depthBuffer,clock,frameBuffer);
+	}
+
+	template <typename P>
+	void rasterize_indexed_triangles(const P& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<unsigned>& indices, DepthBuffer* depthBuffer, FrameBuffer& frameBuffer)
+	{
+		// Call vertex shader once on every vertex, the triangles share the results
+		StageClock clock;
+		DrawScratch& scratch = draw_scratch();
+		std::vector<VertexAttributes>& v = scratch.v;
+		v.resize(vertices.size());
+		for (unsigned i=0; i<vertices.size();i++)
+			v[i] = program.VertexShader(vertices[i],uniform);
+		clock.lap(STAGE_VERTEX);
+
+		// Clip the triangles, skipping the ones with an index out of range
+		std::vector<unsigned>& triangles = scratch.triangles;
+		triangles.clear();
+		unsigned culled = 0;
+		for (unsigned i=0; i+2<indices.size(); i+=3)
+		{
+			const size_t clipped = triangles.size();
+			if (indices[i+0] < vertices.size() && indices[i+1] < vertices.size() && indices[i+2] < vertices.size())
+				clip_triangle(v,indices[i+0],indices[i+1],indices[i+2],triangles);
+			culled += triangles.size() == clipped;
+		}
+		add_submitted(indices.size()/3,culled);
+
+		rasterize_clipped(program,uniform,v,triangles,depthBuffer,clock,frameBuffer);
+	}
+
+	template <typename P>
+	void rasterize_instanced_triangles(const P& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<InstanceAttributes>& instances, DepthBuffer* depthBuffer, FrameBuffer& frameBuffer)
+	{
+		// Call vertex shader once on every vertex, the instances share the results
+		StageClock clock;
+		DrawScratch& scratch = draw_scratch();
+		std::vector<VertexAttributes>& shaded = scratch.shaded;
+		shaded.resize(vertices.size()/3*3);
+		for (unsigned i=0; i<shaded.size();i++)
+			shaded[i] = program.VertexShader(vertices[i],uniform);
+
+		// Place a copy of the shaded vertices for every instance
+		const unsigned n = shaded.size();
+		std::vector<VertexAttributes>& v = scratch.v;
+		v.resize(n*instances.size());
+		for (unsigned k=0; k<instances.size(); k++)
+		{
+			for (unsigned i=0; i<n; i++)
+			{
+				VertexAttributes& va = v[k*n+i];
+				va = shaded[i];
+				va.position = instances[k].transform*shaded[i].position;
+				va.color = instances[k].color.cwiseProduct(shaded[i].color);
+			}
+		}
+		clock.lap(STAGE_VERTEX);
+
+		// Clip the triangles, the instances are drawn one after the other
+		std::vector<unsigned>& triangles = scratch.triangles;
+		triangles.clear();
+		const unsigned count = n*instances.size()/3;
+		unsigned culled = 0;
+		for (unsigned i=0; i<count; i++)
+		{
+			const size_t clipped = triangles.size();
+			clip_triangle(v,i*3+0,i*3+1,i*3+2,triangles);
+			culled += triangles.size() == clipped;
+		}
+		add_submitted(count,culled);
+
+		rasterize_clipped(program,uniform,v,triangles,depthBuffer,clock,frameBuffer);
+	}
+
+	template <typename P>
+	void rasterize_line(const P& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, float line_thickness, FrameBuffer& frameBuffer)
+	{
+		if (FrameStats* stats = frame_stats())
+			stats->lines_submitted++;
+
+		// Collect coordinates into a matrix and convert to canonical representation
+		Eigen::Matrix<float,2,4> p;
+		p.row(0) = v1.position.array()/v1.position[3];
+		p.row(1) = v2.position.array()/v2.position[3];
+
+		// Coordinates are in -1..1, rescale to pixel size (x,y only)
+		p.col(0) = ((p.col(0).array()+1.0)/2.0)*frameBuffer.rows();
+		p.col(1) = ((p.col(1).array()+1.0)/2.0)*frameBuffer.cols();
+
+		// Find bounding box in pixels, adding the line thickness
+		int lx = std::floor(p.col(0).minCoeff()-line_thickness);
+		int ly = std::floor(p.col(1).minCoeff()-line_thickness);
+		int ux = std::ceil(p.col(0).maxCoeff()+line_thickness);
+		int uy = std::ceil(p.col(1).maxCoeff()+line_thickness);
+
+		// Clamp to the scissor rectangle
+		const PixelRect scissor = scissor_rect(frameBuffer);
+		lx = std::max(lx,scissor.lx);
+		ly = std::max(ly,scissor.ly);
+		ux = std::min(ux,scissor.ux);
+		uy = std::min(uy,scissor.uy);
+		if (lx > ux || ly > uy)
+			return;
+		frameBuffer.prepare(lx,ly,ux,uy);
+
+		// We only need the 2d coordinates of the endpoints of the line
+		Eigen::Vector2f l1(p(0,0),p(0,1));
+		Eigen::Vector2f l2(p(1,0),p(1,1));
+
+		// Parametrize the line as l1 + t (l2-l1)
+		float t = -1;
+		float ll  = (l1-l2).squaredNorm();
+
+		// Where it is not clamped, t is affine along a row: span shaders receive runs of pixels
+		// where t is either clamped or not, with the matching attribute increments
+		const bool spans = uses_span_shaders(program);
+		const float t_dx = ll == 0.0 ? 0 : (l2[0]-l1[0])/ll;
+		uint8_t mask[MAX_SPAN_LENGTH];
+		FragmentSpan span;
+		span.mask = mask;
+		int span_clamp = 0;
+		int span_covered = 0;
+		OverdrawBuffer* overdraw = overdraw_buffer();
+		FrameStats* stats = frame_stats();
+		FragmentCounts counts = {0,0};
+
+		// Rasterize the line, one row at a time to walk the framebuffer in memory order
+		for (int j=ly; j<=uy; j++)
+		{
+			// Only visit the pixels around the analytic extent of the row. The margin covers rounding,
+			// the coverage itself is decided by the per-pixel test below.
+			float x0, x1;
+			if (!capsule_row(l1,l2,line_thickness,j+0.5f,x0,x1))
+				continue;
+			const float fx0 = std::floor(x0-0.5f)-1;
+			const float fx1 = std::ceil(x1-0.5f)+1;
+			const int row_lx = fx0 > lx ? int(fx0) : lx;
+			const int row_ux = fx1 < ux ? int(fx1) : ux;
+
+			span.count = 0;
+			for (int i=row_lx; i<=row_ux; i++)
+			{
+				// The pixel center is offset by 0.5, 0.5
+				Eigen::Vector2f pixel(i+0.5,j+0.5);
+
+				// -1 or 1 where t is clamped to 0 or 1, 0 where it is not
+				int clamp = -1;
+				if (ll == 0.0)
+					// The segment has zero length
+					t = 0;
+				else
+				{
+					// Project p on the line
+					t = (pixel-l1).dot(l2-l1)/ll;
+					clamp = t < 0 ? -1 : (t > 1 ? 1 : 0);
+					// Clamp between 0 and 1
+					t = std::fmax(0, std::fmin(1, t));
+				}
+
+  				Eigen::Vector2f pixel_p = l1 + t * (l2 - l1);
+				const bool covered = (pixel - pixel_p).squaredNorm() < (line_thickness*line_thickness);
+				if (overdraw)
+				{
+					(*overdraw)(i,j).tested++;
+					(*overdraw)(i,j).shaded += covered;
+				}
+				counts.tested++;
+				counts.shaded += covered;
+
+				if (!spans)
+				{
+					if (covered)
+					{
+						VertexAttributes va = VertexAttributes::interpolate(v1,v2,v1,1-t,t,0);
+						shade_pixel(program,uniform,va,i,j,frameBuffer);
+					}
+					continue;
+				}
+
+				// Close the current span when t changes regime or the span is full
+				if (span.count > 0 && (clamp != span_clamp || span.count == MAX_SPAN_LENGTH))
+				{
+					span.count = span_covered;
+					shade_span(program,uniform,span,frameBuffer);
+					span.count = 0;
+				}
+
+				if (span.count == 0)
+				{
+					if (!covered)
+						continue;
+					span.x = i;
+					span.y = j;
+					span.start = VertexAttributes::interpolate(v1,v2,v1,1-t,t,0);
+					const float dt = clamp == 0 ? t_dx : 0;
+					span.dx.position = dt*(v2.position-v1.position);
+					span.dx.color = dt*(v2.color-v1.color);
+					span_clamp = clamp;
+				}
+
+				mask[span.count++] = covered ? 0xFF : 0;
+				if (covered)
+					span_covered = span.count;
+			}
+
+			// Spans end at their last covered pixel
+			if (span.count > 0)
+			{
+				span.count = span_covered;
+				shade_span(program,uniform,span,frameBuffer);
+			}
+		}
+
+		if (stats)
+			add_fragment_counts(stats,counts);
+	}
+
+	template <typename P>
+	void rasterize_lines(const P& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer)
+	{
+		// Call vertex shader on all vertices
+		StageClock clock;
+		std::vector<VertexAttributes>& v = draw_scratch().v;
+		v.resize(vertices.size());
+		for (unsigned i=0; i<vertices.size();i++)
+			v[i] = program.VertexShader(vertices[i],uniform);
+		clock.lap(STAGE_VERTEX);
+
+		// Call the rasterization function on every line
+		for (unsigned i=0; i<vertices.size()/2; i++)
+			raster_detail::rasterize_line(program,uniform,v[i*2+0],v[i*2+1],line_thickness,frameBuffer);
+		clock.lap(STAGE_RASTER);
+	}
+
+	template <typename P>
+	void rasterize_line_strip(const P& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer)
+	{
+		// Call vertex shader on all vertices, each one is shared by the lines on both sides of it
+		StageClock clock;
+		std::vector<VertexAttributes>& v = draw_scratch().v;
+		v.resize(vertices.size());
+		for (unsigned i=0; i<vertices.size();i++)
+			v[i] = program.VertexShader(vertices[i],uniform);
+		clock.lap(STAGE_VERTEX);
+
+		for (unsigned i=0; i+1<v.size(); i++)
+			raster_detail::rasterize_line(program,uniform,v[i],v[i+1],line_thickness,frameBuffer);
+		clock.lap(STAGE_RASTER);
+	}
+} // namespace raster_detail
+
+template <typename... Shaders>
+void rasterize_triangle(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, FrameBuffer& frameBuffer)
+{
+	const raster_detail::DepthTest depth = {nullptr, false};
+	raster_detail::rasterize_single_triangle(program,uniform,v1,v2,v3,depth,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_LIST,nullptr,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_triangle(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, const VertexAttributes& v3, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	const raster_detail::DepthTest depth = {&depthBuffer, true};
+	raster_detail::rasterize_single_triangle(program,uniform,v1,v2,v3,depth,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_LIST,&depthBuffer,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_indexed_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<unsigned>& indices, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_indexed_triangles(program,uniform,vertices,indices,nullptr,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_indexed_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<unsigned>& indices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_indexed_triangles(program,uniform,vertices,indices,&depthBuffer,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_triangle_strip(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_STRIP,nullptr,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_triangle_strip(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_STRIP,&depthBuffer,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_triangle_fan(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_FAN,nullptr,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_triangle_fan(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_triangles(program,uniform,vertices,raster_detail::TRIANGLE_FAN,&depthBuffer,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_instanced_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<InstanceAttributes>& instances, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_instanced_triangles(program,uniform,vertices,instances,nullptr,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_instanced_triangles(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, const std::vector<InstanceAttributes>& instances, FrameBuffer& frameBuffer, DepthBuffer& depthBuffer)
+{
+	raster_detail::rasterize_instanced_triangles(program,uniform,vertices,instances,&depthBuffer,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_line(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const VertexAttributes& v1, const VertexAttributes& v2, float line_thickness, FrameBuffer& frameBuffer)
+{
+	StageClock clock;
+	raster_detail::rasterize_line(program,uniform,v1,v2,line_thickness,frameBuffer);
+	clock.lap(STAGE_RASTER);
+}
+
+template <typename... Shaders>
+void rasterize_lines(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_lines(program,uniform,vertices,line_thickness,frameBuffer);
+}
+
+template <typename... Shaders>
+void rasterize_line_strip(const ShaderProgram<Shaders...>& program, const UniformAttributes& uniform, const std::vector<VertexAttributes>& vertices, float line_thickness, FrameBuffer& frameBuffer)
+{
+	raster_detail::rasterize_line_strip(program,uniform,vertices,line_thickness,frameBuffer);
+}
@@ -0,0 +1,482 @@
+#include "raster_simd.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RASTER_SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC accepts any intrinsic without per-function target flags
+#define RASTER_TARGET_AVX2
+#else
+#define RASTER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+	// Expands a 4 bit coverage mask to four 0x00/0xFF mask bytes
+	const uint32_t expand_mask4[16] = {
+		0x00000000, 0x000000ff, 0x0000ff00, 0x0000ffff,
+		0x00ff0000, 0x00ff00ff, 0x00ffff00, 0x00ffffff,
+		0xff000000, 0xff0000ff, 0xff00ff00, 0xff00ffff,
+		0xffff0000, 0xffff00ff, 0xffffff00, 0xffffffff
+	};
+
+	// Number of bits set in a 4 bit coverage mask
+	const int count_mask4[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+	// Stores the mask bytes of 4 pixels (the output buffers are padded, see raster_simd.h)
+	inline void store_mask4(uint8_t* mask, int bits)
+	{
+		const uint32_t bytes = expand_mask4[bits];
+		std::memcpy(mask, &bytes, 4);
+	}
+
+	// Keeps only the bits of the pixels that are part of the row
+	inline int clip_mask(int bits, int remaining, int width)
+	{
+		return remaining < width ? bits & ((1 << remaining) - 1) : bits;
+	}
+
+	int row_kernel_scalar(const RasterRow& row, int count, uint8_t* mask, float* z)
+	{
+		int64_t e0 = row.e[0], e1 = row.e[1], e2 = row.e[2];
+		float depth = row.z;
+
+		int covered = 0;
+		for (int k=0; k<count; k++)
+		{
+			// Inside the triangle (no edge function is negative) and within the bi-unit cube
+			const bool inside = (e0 | e1 | e2) >= 0 && depth >= -1 && depth <= 1;
+			mask[k] = inside ? 0xFF : 0;
+			covered += inside;
+
+			if (z)
+				z[k] = depth;
+			depth += row.z_dx;
+
+			e0 += row.e_dx[0];
+			e1 += row.e_dx[1];
+			e2 += row.e_dx[2];
+		}
+		return covered;
+	}
+
+	typedef void (*FillKernel)(const uint8_t* pixel, int count, uint8_t* destination);
+	typedef void (*PremultiplyKernel)(const float* colors, int stride, int count, uint8_t* rgba);
+	typedef void (*BlendKernel)(BlendMode mode, const uint8_t* source, const uint8_t* mask, int count, uint8_t* destination);
+
+	// Clamps to 0..1, NaN goes to 0 like in the vector kernels
+	inline float clamp_unit(float x)
+	{
+		return x > 0 ? (x < 1 ? x : 1) : 0;
+	}
+
+	// Rounded x/255 for x in 0..255*255, computed as the vector kernels do
+	inline int div255(int x)
+	{
+		x += 128;
+		return (x + (x >> 8)) >> 8;
+	}
+
+	void fill_scalar(const uint8_t* pixel, int count, uint8_t* destination)
+	{
+		for (int k=0; k<count; k++)
+			std::memcpy(destination+4*k,pixel,4);
+	}
+
+	void premultiply_scalar(const float* colors, int stride, int count, uint8_t* rgba)
+	{
+		for (int k=0; k<count; k++, colors+=stride, rgba+=4)
+		{
+			const float a = clamp_unit(colors[3]);
+			for (int c=0; c<3; c++)
+				rgba[c] = uint8_t(clamp_unit(colors[c])*a*255+0.5f);
+			rgba[3] = uint8_t(a*255+0.5f);
+		}
+	}
+
+	inline void blend_pixel(BlendMode mode, const uint8_t* s, uint8_t* d)
+	{
+		const int sa = s[3];
+		const int da = d[3];
+		for (int c=0; c<4; c++)
+		{
+			int r;
+			switch (mode)
+			{
+			case BLEND_SOURCE_OVER:
+				r = s[c] + div255(d[c]*(255-sa));
+				break;
+			case BLEND_MULTIPLY:
+				r = div255(s[c]*d[c]) + div255(s[c]*(255-da)) + div255(d[c]*(255-sa));
+				break;
+			case BLEND_SCREEN:
+				r = s[c] + d[c] - div255(s[c]*d[c]);
+				break;
+			default:
+				r = s[c] + d[c];
+				break;
+			}
+			d[c] = uint8_t(std::min(r,255));
+		}
+	}
+
+	void blend_scalar(BlendMode mode, const uint8_t* source, const uint8_t* mask, int count, uint8_t* destination)
+	{
+		for (int k=0; k<count; k++)
+		{
+			if (mask && !mask[k])
+				continue;
+			// An opaque source replaces the destination
+			if (mode == BLEND_SOURCE_OVER && source[4*k+3] == 255)
+				std::memcpy(destination+4*k,source+4*k,4);
+			else
+				blend_pixel(mode,source+4*k,destination+4*k);
+		}
+	}
+
+#ifdef RASTER_SIMD_X86
+	// The vector kernels test the edge functions in 32 bit lanes: the 64 bit value at the first
+	// pixel of a group is saturated to +-2^30 and the lane offsets are added to it. As long as the
+	// offsets stay below 2^30 in magnitude, the sign of every lane is exact.
+	const int64_t LANE_LIMIT = int64_t(1) << 30;
+
+	inline int32_t saturate(int64_t e)
+	{
+		return int32_t(std::max(-LANE_LIMIT,std::min(LANE_LIMIT,e)));
+	}
+
+	// Whether the offsets of a group of 8 lanes fit, otherwise the row is left to the scalar kernel
+	inline bool lanes_fit(const RasterRow& row)
+	{
+		for (int e=0; e<3; e++)
+			if (row.e_dx[e] <= -LANE_LIMIT/8 || row.e_dx[e] >= LANE_LIMIT/8)
+				return false;
+		return true;
+	}
+
+	int row_kernel_sse2(const RasterRow& row, int count, uint8_t* mask, float* z)
+	{
+		if (!lanes_fit(row))
+			return row_kernel_scalar(row,count,mask,z);
+
+		// Lanes hold 4 consecutive pixels, starting at the first pixel of the row
+		const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+		const __m128 width = _mm_set1_ps(4);
+
+		int64_t e[3];
+		__m128i e_lane[3];
+		for (int i=0; i<3; i++)
+		{
+			const int32_t dx = int32_t(row.e_dx[i]);
+			e[i] = row.e[i];
+			e_lane[i] = _mm_setr_epi32(0, dx, 2*dx, 3*dx);
+		}
+
+		const __m128 z_dx = _mm_set1_ps(row.z_dx);
+		__m128 depth = _mm_add_ps(_mm_set1_ps(row.z), _mm_mul_ps(lane, z_dx));
+		const __m128 depth_step = _mm_mul_ps(width, z_dx);
+
+		const __m128 one = _mm_set1_ps(1);
+		const __m128 minus_one = _mm_set1_ps(-1);
+
+		int covered = 0;
+		for (int k=0; k<count; k+=4)
+		{
+			// Any negative edge function sets the sign bit of the lane
+			__m128i outside = _mm_add_epi32(_mm_set1_epi32(saturate(e[0])), e_lane[0]);
+			outside = _mm_or_si128(outside, _mm_add_epi32(_mm_set1_epi32(saturate(e[1])), e_lane[1]));
+			outside = _mm_or_si128(outside, _mm_add_epi32(_mm_set1_epi32(saturate(e[2])), e_lane[2]));
+			const __m128 in_cube = _mm_and_ps(_mm_cmpge_ps(depth, minus_one), _mm_cmple_ps(depth, one));
+
+			const int bits = clip_mask(_mm_movemask_ps(in_cube) & ~_mm_movemask_ps(_mm_castsi128_ps(outside)), count-k, 4);
+			store_mask4(mask+k, bits);
+			covered += count_mask4[bits];
+
+			if (z)
+				_mm_storeu_ps(z+k, depth);
+			depth = _mm_add_ps(depth, depth_step);
+
+			for (int i=0; i<3; i++)
+				e[i] += 4*row.e_dx[i];
+		}
+		return covered;
+	}
+
+	RASTER_TARGET_AVX2
+	int row_kernel_avx2(const RasterRow& row, int count, uint8_t* mask, float* z)
+	{
+		if (!lanes_fit(row))
+			return row_kernel_scalar(row,count,mask,z);
+
+		// Lanes hold 8 consecutive pixels, starting at the first pixel of the row
+		const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256 width = _mm256_set1_ps(8);
+
+		int64_t e[3];
+		__m256i e_lane[3];
+		for (int i=0; i<3; i++)
+		{
+			const int32_t dx = int32_t(row.e_dx[i]);
+			e[i] = row.e[i];
+			e_lane[i] = _mm256_setr_epi32(0, dx, 2*dx, 3*dx, 4*dx, 5*dx, 6*dx, 7*dx);
+		}
+
+		const __m256 z_dx = _mm256_set1_ps(row.z_dx);
+		__m256 depth = _mm256_add_ps(_mm256_set1_ps(row.z), _mm256_mul_ps(lane, z_dx));
+		const __m256 depth_step = _mm256_mul_ps(width, z_dx);
+
+		const __m256 one = _mm256_set1_ps(1);
+		const __m256 minus_one = _mm256_set1_ps(-1);
+
+		int covered = 0;
+		for (int k=0; k<count; k+=8)
+		{
+			// Any negative edge function sets the sign bit of the lane
+			__m256i outside = _mm256_add_epi32(_mm256_set1_epi32(saturate(e[0])), e_lane[0]);
+			outside = _mm256_or_si256(outside, _mm256_add_epi32(_mm256_set1_epi32(saturate(e[1])), e_lane[1]));
+			outside = _mm256_or_si256(outside, _mm256_add_epi32(_mm256_set1_epi32(saturate(e[2])), e_lane[2]));
+			const __m256 in_cube = _mm256_and_ps(_mm256_cmp_ps(depth, minus_one, _CMP_GE_OQ), _mm256_cmp_ps(depth, one, _CMP_LE_OQ));
+
+			const int bits = clip_mask(_mm256_movemask_ps(in_cube) & ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)), count-k, 8);
+			store_mask4(mask+k, bits & 0xF);
+			store_mask4(mask+k+4, bits >> 4);
+			covered += count_mask4[bits & 0xF] + count_mask4[bits >> 4];
+
+			if (z)
+				_mm256_storeu_ps(z+k, depth);
+			depth = _mm256_add_ps(depth, depth_step);
+
+			for (int i=0; i<3; i++)
+				e[i] += 8*row.e_dx[i];
+		}
+		return covered;
+	}
+
+	void fill_sse2(const uint8_t* pixel, int count, uint8_t* destination)
+	{
+		uint32_t value;
+		std::memcpy(&value,pixel,4);
+		const __m128i pixels = _mm_set1_epi32(int(value));
+
+		int k = 0;
+		for (; k+4<=count; k+=4)
+			_mm_storeu_si128((__m128i*)(destination+4*k),pixels);
+		fill_scalar(pixel,count-k,destination+4*k);
+	}
+
+	void premultiply_sse2(const float* colors, int stride, int count, uint8_t* rgba)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1);
+		const __m128 scale = _mm_set1_ps(255);
+		const __m128 half = _mm_set1_ps(0.5f);
+		// Lanes multiplied by the alpha: red, green and blue
+		const __m128 rgb = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+		// One pixel per vector, 4 pixels are packed to bytes at once
+		int k = 0;
+		for (; k+4<=count; k+=4)
+		{
+			__m128i p[4];
+			for (int i=0; i<4; i++)
+			{
+				__m128 c = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(colors+(k+i)*stride),zero),one);
+				const __m128 a = _mm_shuffle_ps(c,c,_MM_SHUFFLE(3,3,3,3));
+				c = _mm_mul_ps(c,_mm_or_ps(_mm_and_ps(rgb,a),_mm_andnot_ps(rgb,one)));
+				p[i] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c,scale),half));
+			}
+			_mm_storeu_si128((__m128i*)(rgba+4*k),_mm_packus_epi16(_mm_packs_epi32(p[0],p[1]),_mm_packs_epi32(p[2],p[3])));
+		}
+		premultiply_scalar(colors+k*stride,stride,count-k,rgba+4*k);
+	}
+
+	// Rounded x/255 of 16 bit lanes holding 0..255*255
+	inline __m128i div255_sse2(__m128i x)
+	{
+		x = _mm_add_epi16(x,_mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(x,_mm_srli_epi16(x,8)),8);
+	}
+
+	inline __m128i mul255_sse2(__m128i a, __m128i b)
+	{
+		return div255_sse2(_mm_mullo_epi16(a,b));
+	}
+
+	// Alpha of each of the 2 pixels in all their lanes
+	inline __m128i broadcast_alpha_sse2(__m128i x)
+	{
+		return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+	}
+
+	// Blends 2 pixels with 16 bit channels
+	template <BlendMode MODE>
+	inline __m128i blend2_sse2(__m128i s, __m128i d)
+	{
+		const __m128i full = _mm_set1_epi16(255);
+		const __m128i sa = broadcast_alpha_sse2(s);
+		if (MODE == BLEND_SOURCE_OVER)
+			return _mm_add_epi16(s,mul255_sse2(d,_mm_sub_epi16(full,sa)));
+		if (MODE == BLEND_MULTIPLY)
+		{
+			const __m128i da = broadcast_alpha_sse2(d);
+			return _mm_add_epi16(_mm_add_epi16(mul255_sse2(s,d),mul255_sse2(s,_mm_sub_epi16(full,da))),mul255_sse2(d,_mm_sub_epi16(full,sa)));
+		}
+		return _mm_sub_epi16(_mm_add_epi16(s,d),mul255_sse2(s,d));
+	}
+
+	template <BlendMode MODE>
+	void blend_sse2(const uint8_t* source, const uint8_t* mask, int count, uint8_t* destination)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+
+		// 4 pixels at a time, the covered ones are selected from the blended pixels
+		int k = 0;
+		for (; k+4<=count; k+=4)
+		{
+			uint32_t bytes = 0xFFFFFFFF;
+			if (mask)
+			{
+				std::memcpy(&bytes,mask+k,4);
+				if (bytes == 0)
+					continue;
+			}
+
+			const __m128i s = _mm_loadu_si128((const __m128i*)(source+4*k));
+			if (MODE == BLEND_SOURCE_OVER && bytes == 0xFFFFFFFF &&
+				_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s,alpha),alpha)) == 0xFFFF)
+			{
+				// Opaque pixels replace the destination, which is not read
+				_mm_storeu_si128((__m128i*)(destination+4*k),s);
+				continue;
+			}
+
+			const __m128i d = _mm_loadu_si128((const __m128i*)(destination+4*k));
+			__m128i r;
+			if (MODE == BLEND_ADDITIVE)
+				r = _mm_adds_epu8(s,d);
+			else
+				r = _mm_packus_epi16(
+					blend2_sse2<MODE>(_mm_unpacklo_epi8(s,zero),_mm_unpacklo_epi8(d,zero)),
+					blend2_sse2<MODE>(_mm_unpackhi_epi8(s,zero),_mm_unpackhi_epi8(d,zero)));
+
+			if (bytes != 0xFFFFFFFF)
+			{
+				__m128i covered = _mm_cvtsi32_si128(int(bytes));
+				covered = _mm_unpacklo_epi8(covered,covered);
+				covered = _mm_unpacklo_epi16(covered,covered);
+				r = _mm_or_si128(_mm_and_si128(covered,r),_mm_andnot_si128(covered,d));
+			}
+			_mm_storeu_si128((__m128i*)(destination+4*k),r);
+		}
+		blend_scalar(MODE,source+4*k,mask ? mask+k : nullptr,count-k,destination+4*k);
+	}
+
+	void blend_sse2(BlendMode mode, const uint8_t* source, const uint8_t* mask, int count, uint8_t* destination)
+	{
+		switch (mode)
+		{
+		case BLEND_SOURCE_OVER:
+			blend_sse2<BLEND_SOURCE_OVER>(source,mask,count,destination);
+			break;
+		case BLEND_MULTIPLY:
+			blend_sse2<BLEND_MULTIPLY>(source,mask,count,destination);
+			break;
+		case BLEND_SCREEN:
+			blend_sse2<BLEND_SCREEN>(source,mask,count,destination);
+			break;
+		case BLEND_ADDITIVE:
+			blend_sse2<BLEND_ADDITIVE>(source,mask,count,destination);
+			break;
+		}
+	}
+
+	bool cpu_has_avx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// AVX must be supported by the CPU and its registers saved by the OS
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+			return false;
+		if ((_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	// Filling and blending are memory bound, the AVX2 choice keeps the SSE2 kernels
+	struct KernelChoice
+	{
+		RowKernel kernel;
+		FillKernel fill;
+		PremultiplyKernel premultiply;
+		BlendKernel blend;
+		const char* name;
+	};
+
+	KernelChoice select_kernels()
+	{
+		// RASTER_SIMD=scalar|sse2 caps the instruction set, to compare the paths
+		const char* env = std::getenv("RASTER_SIMD");
+		const std::string limit = env ? env : "";
+
+#ifdef RASTER_SIMD_X86
+		if (limit != "scalar" && limit != "sse2" && cpu_has_avx2())
+			return { row_kernel_avx2, fill_sse2, premultiply_sse2, blend_sse2, "avx2" };
+		// SSE2 is part of the x86-64 baseline
+		if (limit != "scalar")
+			return { row_kernel_sse2, fill_sse2, premultiply_sse2, blend_sse2, "sse2" };
+#endif
+		return { row_kernel_scalar, fill_scalar, premultiply_scalar, blend_scalar, "scalar" };
+	}
+
+	const KernelChoice& kernel_choice()
+	{
+		static const KernelChoice choice = select_kernels();
+		return choice;
+	}
+} // namespace
+
+RowKernel row_kernel()
+{
+	return kernel_choice().kernel;
+}
+
+const char* row_kernel_name()
+{
+	return kernel_choice().name;
+}
+
+void fill_span(const uint8_t* pixel, int count, uint8_t* destination)
+{
+	kernel_choice().fill(pixel,count,destination);
+}
+
+void premultiply_span(const float* colors, int stride, int count, uint8_t* rgba)
+{
+	kernel_choice().premultiply(colors,stride,count,rgba);
+}
+
+void blend_span(BlendMode mode, const uint8_t* source, const uint8_t* mask, int count, uint8_t* destination)
+{
+	kernel_choice().blend(mode,source,mask,count,destination);
+}
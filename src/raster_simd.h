@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+// Row buffers are padded to a multiple of the widest vector
+const int RASTER_ROW_PADDING = 8;
+
+// One row of a triangle, ready to be processed by a coverage kernel: the fixed point edge functions
+// and the depth at the first pixel center, and their increments along x.
+// A pixel is inside the triangle when all three edge functions are non-negative.
+struct RasterRow
+{
+	int64_t e[3];
+	int64_t e_dx[3];
+	float z;
+	float z_dx;
+};
+
+// Computes the coverage of count consecutive pixels of a row. mask receives 0xFF for every pixel
+// inside the triangle and the bi-unit cube and 0 otherwise, z receives the depth of every pixel
+// for the depth test. The kernels write whole vectors: mask and z must have room for count rounded
+// up to RASTER_ROW_PADDING pixels. z may be null when only the mask is needed.
+// Returns the number of covered pixels.
+typedef int (*RowKernel)(const RasterRow& row, int count, uint8_t* mask, float* z);
+
+// Returns the widest kernel supported by the CPU, detected once on first use
+RowKernel row_kernel();
+
+// Returns the name of the instruction set used by row_kernel(): "avx2", "sse2" or "scalar"
+const char* row_kernel_name();
+
+// Writes count copies of the rgba8 pixel to destination
+void fill_span(const uint8_t* pixel, int count, uint8_t* destination);
+
+// Blend modes of blend_span, on premultiplied colors: s is the source and d the destination color,
+// sa and da their alpha. Every channel, alpha included, follows the same formula.
+enum BlendMode
+{
+	// s + d*(1-sa)
+	BLEND_SOURCE_OVER,
+	// s*d + s*(1-da) + d*(1-sa)
+	BLEND_MULTIPLY,
+	// s + d - s*d
+	BLEND_SCREEN,
+	// min(s+d,1)
+	BLEND_ADDITIVE
+};
+
+// Converts count straight alpha colors (rgba floats in 0..1, stride floats apart) to premultiplied rgba8.
+// Channels out of 0..1 are clamped.
+void premultiply_span(const float* colors, int stride, int count, uint8_t* rgba);
+
+// Blends count premultiplied rgba8 source pixels into the destination pixels that are set in mask
+// (0xFF or 0 per pixel, all of them if mask is null). With BLEND_SOURCE_OVER, runs of opaque covered
+// pixels are written without reading the destination.
+void blend_span(BlendMode mode, const uint8_t* source, const uint8_t* mask, int count, uint8_t* destination);
@@ -0,0 +1,74 @@
+#include "raster_stats.h"
+
+#include <algorithm>
+
+namespace
+{
+	FrameStats* stats_target = nullptr;
+}
+
+const char* pipeline_stage_name(PipelineStage stage)
+{
+	static const char* const names[STAGE_COUNT] = { "clear", "vertex", "setup", "raster", "convert", "present" };
+	return stage >= 0 && stage < STAGE_COUNT ? names[stage] : "";
+}
+
+void set_frame_stats(FrameStats* stats)
+{
+	stats_target = stats;
+}
+
+FrameStats* frame_stats()
+{
+	return stats_target;
+}
+
+FrameStatsHistory::FrameStatsHistory(unsigned capacity) : frames(std::max(capacity,1u)), next(0), recorded(0)
+{
+}
+
+void FrameStatsHistory::begin_frame()
+{
+	current = FrameStats();
+	set_frame_stats(&current);
+	start = std::chrono::steady_clock::now();
+}
+
+void FrameStatsHistory::end_frame()
+{
+	current.frame_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();
+	if (frame_stats() == &current)
+		set_frame_stats(nullptr);
+	frames[next] = current;
+	next = (next+1)%frames.size();
+	recorded = std::min(recorded+1,unsigned(frames.size()));
+}
+
+FrameStats FrameStatsHistory::average(unsigned count) const
+{
+	FrameStats sum;
+	count = std::min(count,recorded);
+	if (count == 0)
+		return sum;
+	for (unsigned age=0; age<count; age++)
+	{
+		const FrameStats& f = frame(age);
+		for (int s=0; s<STAGE_COUNT; s++)
+			sum.stage_ns[s] += f.stage_ns[s];
+		sum.frame_ns += f.frame_ns;
+		sum.triangles_submitted += f.triangles_submitted;
+		sum.triangles_culled += f.triangles_culled;
+		sum.lines_submitted += f.lines_submitted;
+		sum.pixels_tested += f.pixels_tested;
+		sum.pixels_shaded += f.pixels_shaded;
+	}
+	for (int s=0; s<STAGE_COUNT; s++)
+		sum.stage_ns[s] /= count;
+	sum.frame_ns /= count;
+	sum.triangles_submitted /= count;
+	sum.triangles_culled /= count;
+	sum.lines_submitted /= count;
+	sum.pixels_tested /= count;
+	sum.pixels_shaded /= count;
+	return sum;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Stages of a frame timed by the pipeline statistics
+enum PipelineStage
+{
+	// Filling the framebuffer with the clear color, and the depth buffer when the caller times it
+	STAGE_CLEAR,
+	// Vertex shader
+	STAGE_VERTEX,
+	// Clipping, triangle setup, ordering and binning
+	STAGE_SETUP,
+	// Coverage, depth test and shading of the fragments, lines included. The tiles of a deferred clear
+	// are filled when the rasterizer first draws into them, their time is counted here.
+	STAGE_RASTER,
+	// Conversion of the framebuffer to other formats, heatmap included
+	STAGE_CONVERT,
+	// Handing the frame to the display, timed by the caller
+	STAGE_PRESENT,
+	STAGE_COUNT
+};
+
+// Name of a stage, for reports
+const char* pipeline_stage_name(PipelineStage stage);
+
+// Statistics of one frame: the time spent in every stage and the work of the rasterizer
+class FrameStats
+{
+	public:
+	FrameStats() : frame_ns(0), triangles_submitted(0), triangles_culled(0), lines_submitted(0), pixels_tested(0), pixels_shaded(0)
+	{
+		for (int s=0; s<STAGE_COUNT; s++)
+			stage_ns[s] = 0;
+	}
+
+	// Time spent in each stage, and in the whole frame, in nanoseconds
+	uint64_t stage_ns[STAGE_COUNT];
+	uint64_t frame_ns;
+
+	// Triangles drawn, and the ones among them that did not reach rasterization: outside of the view
+	// volume, degenerate, or outside of the scissor rectangle
+	uint64_t triangles_submitted;
+	uint64_t triangles_culled;
+	uint64_t lines_submitted;
+
+	// Fragments whose coverage (and depth) was tested, and the ones shaded, as counted by the overdraw diagnostic
+	uint64_t pixels_tested;
+	uint64_t pixels_shaded;
+};
+
+// Enables the pipeline statistics: until it is reset to nullptr, draws add their time and counters to stats
+void set_frame_stats(FrameStats* stats);
+
+// Statistics the draws add to, null when they are disabled
+FrameStats* frame_stats();
+
+// Splits the time of a draw between the stages while the statistics are enabled. It does nothing
+// otherwise, so that the stages cost a single test when nobody measures them.
+class StageClock
+{
+	public:
+	StageClock() : stats(frame_stats())
+	{
+		if (stats)
+			last = std::chrono::steady_clock::now();
+	}
+
+	// Adds the time elapsed since the previous lap, or the construction, to the stage
+	void lap(PipelineStage stage)
+	{
+		if (!stats)
+			return;
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		stats->stage_ns[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(now-last).count();
+		last = now;
+	}
+
+	private:
+	FrameStats* stats;
+	std::chrono::steady_clock::time_point last;
+};
+
+// Statistics of the last frames, kept in a ring buffer. The draws between begin_frame() and end_frame()
+// are recorded into a new frame.
+class FrameStatsHistory
+{
+	public:
+	explicit FrameStatsHistory(unsigned capacity = 120);
+
+	// Starts recording a frame, the statistics are enabled until end_frame()
+	void begin_frame();
+
+	// Stops recording the frame, it becomes frame(0)
+	void end_frame();
+
+	// Frames recorded, at most capacity()
+	unsigned size() const { return recorded; }
+	unsigned capacity() const { return unsigned(frames.size()); }
+
+	// Frame recorded age frames before the last one, age < size()
+	const FrameStats& frame(unsigned age) const { return frames[(next+frames.size()-1-age)%frames.size()]; }
+
+	// Average of the last count frames, or of all of them if fewer were recorded
+	FrameStats average(unsigned count) const;
+
+	private:
+	std::vector<FrameStats> frames;
+	unsigned next, recorded;
+	FrameStats current;
+	std::chrono::steady_clock::time_point start;
+};
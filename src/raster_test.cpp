@@ -0,0 +1,584 @@
+// Regression tests of the rasterizer, registered with CTest. Every test draws randomized scenes and
+// compares them with a direct evaluation, pixel by pixel.
+//
+//   raster_test [test name]
+//
+// Without a name every test runs. RASTER_SIMD=scalar|sse2 caps the instruction set of the row kernels,
+// CTest runs the tests once for each of them. Draws of many triangles are binned into tiles only when
+// the rasterizer has several threads, CTest sets RASTER_THREADS so that they are on any machine.
+
+#include "raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// count triangles in a w x h canvas, each within a square of side min_size to max_size pixels, at a
+	// random depth within the bi-unit cube
+	std::vector<VertexAttributes> random_triangles(unsigned count, float min_size, float max_size, int w, int h, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		std::vector<VertexAttributes> vertices;
+		for (unsigned t = 0; t < count; ++t)
+		{
+			const float size = min_size + (max_size - min_size) * unit(rng);
+			const float x = unit(rng) * (w - size), y = unit(rng) * (h - size);
+			const Eigen::Vector4f color(unit(rng), unit(rng), unit(rng), 1);
+			for (int k = 0; k < 3; ++k)
+			{
+				VertexAttributes v((x + unit(rng) * size) / w * 2 - 1, (y + unit(rng) * size) / h * 2 - 1, unit(rng) * 1.8f - 0.9f, 1);
+				v.color = color;
+				vertices.push_back(v);
+			}
+		}
+		return vertices;
+	}
+
+	// Pixel coordinates of a vertex in a w x h framebuffer, as the rasterizer computes them
+	Eigen::Vector2f pixel_position(const VertexAttributes& v, int w, int h)
+	{
+		return Eigen::Vector2f((v.position[0] / v.position[3] + 1) / 2 * w, (v.position[1] / v.position[3] + 1) / 2 * h);
+	}
+
+	// Coverage of pixel (i,j) by the triangle, evaluating its edge functions directly at the pixel center:
+	// vertices snapped to 1/256 of a pixel, centers on an edge belong to the triangle on its right or below it
+	bool exact_inside(const Eigen::Vector2f p[3], int i, int j)
+	{
+		int64_t X[3], Y[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			X[k] = std::llround(p[k][0] * 256);
+			Y[k] = std::llround(p[k][1] * 256);
+		}
+		int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+		if (area == 0)
+			return false;
+		if (area < 0)
+		{
+			std::swap(X[1], X[2]);
+			std::swap(Y[1], Y[2]);
+		}
+		const int64_t cx = int64_t(i) * 256 + 128, cy = int64_t(j) * 256 + 128;
+		for (int k = 0; k < 3; ++k)
+		{
+			const int a = (k + 1) % 3, b = (k + 2) % 3;
+			const int64_t dx = X[b] - X[a], dy = Y[b] - Y[a];
+			const int64_t e = dx * (cy - Y[a]) - dy * (cx - X[a]);
+			const bool top_left = dy < 0 || (dy == 0 && dx < 0);
+			if (e < 0 || (e == 0 && !top_left))
+				return false;
+		}
+		return true;
+	}
+
+	// Coverage of pixel (i,j) as the original rasterizer evaluated it: barycentric coordinates Ai*pixel in floats
+	bool baseline_inside(const Eigen::Vector2f p[3], int i, int j)
+	{
+		Eigen::Matrix3f A;
+		for (int k = 0; k < 3; ++k)
+			A.col(k) << p[k][0], p[k][1], 1;
+		const Eigen::Matrix3f Ai = A.inverse();
+		const Eigen::Vector3f b = Ai * Eigen::Vector3f(i + 0.5f, j + 0.5f, 1);
+		return b.minCoeff() >= 0;
+	}
+
+	// Distance in pixels from the center of pixel (i,j) to the closest edge of the triangle
+	double edge_distance(const Eigen::Vector2f p[3], int i, int j)
+	{
+		double distance = 1e30;
+		for (int k = 0; k < 3; ++k)
+		{
+			const Eigen::Vector2d a = p[k].cast<double>(), b = p[(k + 1) % 3].cast<double>();
+			const Eigen::Vector2d d = b - a, c(i + 0.5 - a[0], j + 0.5 - a[1]);
+			const double length = d.norm();
+			if (length > 0)
+				distance = std::min(distance, std::abs(d[0] * c[1] - d[1] * c[0]) / length);
+		}
+		return distance;
+	}
+
+	// Counts, for every pixel of a w x h canvas, the triangles shaded by draw with the overdraw diagnostic
+	std::vector<int> shaded_counts(const std::function<void()>& draw, int w, int h)
+	{
+		OverdrawBuffer overdraw(w, h);
+		overdraw.setConstant(OverdrawCounters());
+		set_overdraw_buffer(&overdraw);
+		draw();
+		set_overdraw_buffer(nullptr);
+		std::vector<int> counts(w * h);
+		for (int j = 0; j < h; ++j)
+			for (int i = 0; i < w; ++i)
+				counts[j * w + i] = overdraw(i, j).shaded;
+		return counts;
+	}
+
+	VertexAttributes identity_vertex(const VertexAttributes& va, const UniformAttributes&)
+	{
+		return va;
+	}
+
+	FragmentAttributes color_fragment(const VertexAttributes& va, const UniformAttributes&)
+	{
+		return FragmentAttributes(va.color[0], va.color[1], va.color[2], va.color[3]);
+	}
+
+	FrameBufferAttributes replace_color(const FragmentAttributes& fa, const FrameBufferAttributes&)
+	{
+		return FrameBufferAttributes(fa.color[0] * 255, fa.color[1] * 255, fa.color[2] * 255, fa.color[3] * 255);
+	}
+
+	FrameBufferAttributes blend_color(const FragmentAttributes& fa, const FrameBufferAttributes& previous)
+	{
+		const float alpha = fa.color[3];
+		FrameBufferAttributes out;
+		for (int c = 0; c < 3; ++c)
+			out.color[c] = uint8_t(fa.color[c] * 255 * alpha + previous.color[c] * (1 - alpha));
+		out.color[3] = 255;
+		return out;
+	}
+
+	void color_span(const FragmentSpan& span, const UniformAttributes&, FragmentAttributes* fragments)
+	{
+		for (int k = 0; k < span.count; k++)
+			fragments[k].color = span.start.color + float(k) * span.dx.color;
+	}
+
+	// The coverage of randomized scenes matches the direct evaluation of the edge functions at every pixel,
+	// whatever the path: per-pixel shaders, span shaders, single triangles or batches. Away from the edges,
+	// where snapping and the tie rule cannot change the outcome, it matches the original float evaluation.
+	bool test_coverage()
+	{
+		const int w = 256, h = 256;
+		UniformAttributes uniform;
+		Program program;
+		program.VertexShader = identity_vertex;
+		program.FragmentShader = color_fragment;
+		program.BlendingShader = replace_color;
+		const auto spanProgram = make_span_program(&identity_vertex, &color_span, SpanBlender(BLEND_SOURCE_OVER));
+		FrameBuffer frameBuffer(w, h);
+
+		bool passed = true;
+		for (unsigned seed = 1; seed <= 8; ++seed)
+		{
+			const std::vector<VertexAttributes> triangles = random_triangles(3000, 2, seed % 2 ? 40 : 120, w, h, seed);
+
+			std::vector<int> expected(w * h, 0);
+			unsigned baselineMismatches = 0;
+			for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+			{
+				const Eigen::Vector2f p[3] = { pixel_position(triangles[t], w, h), pixel_position(triangles[t + 1], w, h), pixel_position(triangles[t + 2], w, h) };
+				const int lx = std::max(0, int(std::floor(std::min(p[0][0], std::min(p[1][0], p[2][0])))) - 1);
+				const int ly = std::max(0, int(std::floor(std::min(p[0][1], std::min(p[1][1], p[2][1])))) - 1);
+				const int ux = std::min(w - 1, int(std::ceil(std::max(p[0][0], std::max(p[1][0], p[2][0])))) + 1);
+				const int uy = std::min(h - 1, int(std::ceil(std::max(p[0][1], std::max(p[1][1], p[2][1])))) + 1);
+				for (int j = ly; j <= uy; ++j)
+				{
+					for (int i = lx; i <= ux; ++i)
+					{
+						const bool inside = exact_inside(p, i, j);
+						expected[j * w + i] += inside;
+						if (inside != baseline_inside(p, i, j) && edge_distance(p, i, j) > 0.01)
+							baselineMismatches++;
+					}
+				}
+			}
+			if (baselineMismatches > 0)
+			{
+				std::cerr << "seed " << seed << ": " << baselineMismatches << " pixels away from the edges differ from the float evaluation" << std::endl;
+				passed = false;
+			}
+
+			const struct
+			{
+				const char* name;
+				std::function<void()> draw;
+			} paths[] = {
+				{ "per-pixel batch", [&]() { rasterize_triangles(program, uniform, triangles, frameBuffer); } },
+				{ "per-pixel single", [&]() {
+					for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+						rasterize_triangle(program, uniform, triangles[t], triangles[t + 1], triangles[t + 2], frameBuffer);
+				} },
+				{ "span batch", [&]() { rasterize_triangles(spanProgram, uniform, triangles, frameBuffer); } },
+				{ "span single", [&]() {
+					for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+						rasterize_triangle(spanProgram, uniform, triangles[t], triangles[t + 1], triangles[t + 2], frameBuffer);
+				} },
+			};
+			for (size_t k = 0; k < sizeof(paths) / sizeof(paths[0]); ++k)
+			{
+				const std::vector<int> counts = shaded_counts(paths[k].draw, w, h);
+				for (int p = 0; p < w * h; ++p)
+				{
+					if (counts[p] != expected[p])
+					{
+						std::cerr << "seed " << seed << ", " << paths[k].name << ": pixel (" << p % w << "," << p / w << ") covered "
+							<< counts[p] << " times instead of " << expected[p] << std::endl;
+						passed = false;
+						break;
+					}
+				}
+			}
+		}
+		return passed;
+	}
+
+	// On equal depth the depth buffer changes nothing to the image of opaque triangles followed by
+	// translucent ones: the last opaque triangle wins and the translucent ones blend over it in
+	// submission order, as without depth buffer.
+	bool test_equal_depth()
+	{
+		const int w = 128, h = 128;
+		UniformAttributes uniform;
+		Program program;
+		program.VertexShader = identity_vertex;
+		program.FragmentShader = color_fragment;
+		program.BlendingShader = blend_color;
+		const auto spanProgram = make_span_program(&identity_vertex, &color_span, SpanBlender(BLEND_SOURCE_OVER));
+
+		bool passed = true;
+		for (unsigned seed = 1; seed <= 4; ++seed)
+		{
+			// The opaque triangles first, then the translucent ones, all at the same depth
+			std::vector<VertexAttributes> triangles = random_triangles(400, 4, 60, w, h, seed);
+			const float z = 0.25f * seed - 0.5f;
+			for (size_t v = 0; v < triangles.size(); ++v)
+			{
+				triangles[v].position[2] = z;
+				triangles[v].color[3] = v < triangles.size() / 2 ? 1.f : 0.5f;
+			}
+
+			for (int span = 0; span < 2; ++span)
+			{
+				FrameBuffer expected(w, h), depthTested(w, h);
+				DepthBuffer depthBuffer(w, h);
+				depthBuffer.setConstant(std::numeric_limits<float>::infinity());
+				if (span)
+				{
+					rasterize_triangles(spanProgram, uniform, triangles, expected);
+					rasterize_triangles(spanProgram, uniform, triangles, depthTested, depthBuffer);
+				}
+				else
+				{
+					rasterize_triangles(program, uniform, triangles, expected);
+					rasterize_triangles(program, uniform, triangles, depthTested, depthBuffer);
+				}
+
+				bool same = true;
+				for (int j = 0; j < h && same; ++j)
+				{
+					for (int i = 0; i < w && same; ++i)
+					{
+						if (expected(i, j).color != depthTested(i, j).color)
+						{
+							std::cerr << "seed " << seed << ", " << (span ? "span" : "per-pixel") << ": pixel (" << i << "," << j
+								<< ") differs with the depth buffer" << std::endl;
+							same = false;
+						}
+					}
+				}
+				passed = passed && same;
+			}
+		}
+		return passed;
+	}
+
+	// Exact value of one channel of blend_span on 0..255 premultiplied channels, following the formulas of
+	// raster_simd.h, and the number of products the kernels round to an integer on the way
+	double blend_formula(BlendMode mode, double s, double d, double sa, double da, int& rounded)
+	{
+		double r;
+		switch (mode)
+		{
+		case BLEND_SOURCE_OVER:
+			r = s + d * (255 - sa) / 255;
+			rounded = 1;
+			break;
+		case BLEND_MULTIPLY:
+			r = s * d / 255 + s * (255 - da) / 255 + d * (255 - sa) / 255;
+			rounded = 3;
+			break;
+		case BLEND_SCREEN:
+			r = s + d - s * d / 255;
+			rounded = 1;
+			break;
+		default:
+			r = s + d;
+			rounded = 0;
+			break;
+		}
+		return std::min(r, 255.0);
+	}
+
+	// Random premultiplied rgba8 pixel: opaque, transparent or any alpha, channels not above the alpha
+	void random_premultiplied(std::mt19937& rng, uint8_t* pixel)
+	{
+		const int kind = std::uniform_int_distribution<int>(0, 3)(rng);
+		const int alpha = kind == 0 ? 255 : (kind == 1 ? 0 : std::uniform_int_distribution<int>(0, 255)(rng));
+		for (int c = 0; c < 3; ++c)
+			pixel[c] = uint8_t(std::uniform_int_distribution<int>(0, alpha)(rng));
+		pixel[3] = uint8_t(alpha);
+	}
+
+	// Clamps to 0..1, NaN goes to 0
+	double clamp_unit(float x)
+	{
+		return x > 0 ? (x < 1 ? double(x) : 1.0) : 0.0;
+	}
+
+	// premultiply_span and blend_span match the formulas of raster_simd.h on random pixels, for every
+	// blend mode, with and without mask, whatever the length and alignment of the span. Each channel is
+	// within half a unit of the exact value per product rounded by the kernels, pixels left out by the
+	// mask are not changed.
+	bool test_blend()
+	{
+		const BlendMode modes[] = { BLEND_SOURCE_OVER, BLEND_MULTIPLY, BLEND_SCREEN, BLEND_ADDITIVE };
+		const char* names[] = { "source over", "multiply", "screen", "additive" };
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> color(-0.2f, 1.2f);
+		std::uniform_int_distribution<int> length(1, 70), offset(0, 7), coin(0, 1);
+
+		bool passed = true;
+		const int stride = 5, size = 80;
+		std::vector<float> colors(stride * size);
+		std::vector<uint8_t> source(4 * size), before(4 * size), destination(4 * size), mask(size);
+		for (int iteration = 0; iteration < 2000 && passed; ++iteration)
+		{
+			// Straight alpha colors, out of range and NaN channels included, are clamped and premultiplied
+			const int count = length(rng), first = offset(rng);
+			for (size_t k = 0; k < colors.size(); ++k)
+				colors[k] = k % 97 == 13 ? std::numeric_limits<float>::quiet_NaN() : color(rng);
+			premultiply_span(&colors[stride * first], stride, count, &source[4 * first]);
+			for (int k = first; k < first + count && passed; ++k)
+			{
+				const double alpha = clamp_unit(colors[stride * k + 3]);
+				for (int c = 0; c < 4; ++c)
+				{
+					const double expected = (c < 3 ? clamp_unit(colors[stride * k + c]) * alpha : alpha) * 255;
+					if (std::abs(source[4 * k + c] - expected) > 0.501)
+					{
+						std::cerr << "premultiply: channel " << c << " of pixel " << k - first << " is " << int(source[4 * k + c])
+							<< " instead of " << expected << std::endl;
+						passed = false;
+					}
+				}
+			}
+
+			// Blending of random premultiplied pixels
+			for (int k = 0; k < size; ++k)
+			{
+				random_premultiplied(rng, &source[4 * k]);
+				random_premultiplied(rng, &before[4 * k]);
+				mask[k] = coin(rng) ? 0xFF : 0;
+			}
+			for (int m = 0; m < 4 && passed; ++m)
+			{
+				for (int masked = 0; masked < 2 && passed; ++masked)
+				{
+					destination = before;
+					blend_span(modes[m], &source[4 * first], masked ? &mask[first] : nullptr, count, &destination[4 * first]);
+					for (int k = 0; k < size && passed; ++k)
+					{
+						const bool blended = k >= first && k < first + count && (!masked || mask[k]);
+						const uint8_t* s = &source[4 * k];
+						const uint8_t* d = &before[4 * k];
+						for (int c = 0; c < 4; ++c)
+						{
+							int rounded = 0;
+							const double expected = blended ? blend_formula(modes[m], s[c], d[c], s[3], d[3], rounded) : d[c];
+							if (std::abs(destination[4 * k + c] - expected) > 0.5 * rounded + 1e-9)
+							{
+								std::cerr << names[m] << (masked ? " masked" : "") << ": channel " << c << " of pixel " << k
+									<< " is " << int(destination[4 * k + c]) << " instead of " << expected << std::endl;
+								passed = false;
+								break;
+							}
+						}
+					}
+				}
+			}
+		}
+		return passed;
+	}
+
+	// Clips a triangle in clip space to w >= near and to the view frustum, in double precision, and appends
+	// the pixel positions of the resulting convex polygon to polygon
+	void clip_polygon(const VertexAttributes* v, double near, int w, int h, std::vector<Eigen::Vector2d>& polygon)
+	{
+		std::vector<Eigen::Vector4d> in, out;
+		for (int k = 0; k < 3; ++k)
+			in.push_back(v[k].position.cast<double>());
+		for (int plane = 0; plane < 5; ++plane)
+		{
+			const auto distance = [&](const Eigen::Vector4d& p) {
+				switch (plane)
+				{
+				case 0: return p[3] - near;
+				case 1: return p[3] + p[0];
+				case 2: return p[3] - p[0];
+				case 3: return p[3] + p[1];
+				default: return p[3] - p[1];
+				}
+			};
+			out.clear();
+			for (size_t k = 0; k < in.size(); ++k)
+			{
+				const Eigen::Vector4d& p = in[k];
+				const Eigen::Vector4d& q = in[(k + 1) % in.size()];
+				const double dp = distance(p), dq = distance(q);
+				if (dp >= 0)
+					out.push_back(p);
+				if ((dp >= 0) != (dq >= 0))
+					out.push_back(p + (q - p) * (dp / (dp - dq)));
+			}
+			in.swap(out);
+		}
+		for (size_t k = 0; k < in.size(); ++k)
+			polygon.push_back(Eigen::Vector2d((in[k][0] / in[k][3] + 1) / 2 * w, (in[k][1] / in[k][3] + 1) / 2 * h));
+	}
+
+	// Triangles drawn with clipping are covered as their part within the view volume, clipped beforehand
+	// and drawn directly, whether the triangles are drawn one at a time or binned and drawn in parallel
+	// tiles. Scenes of triangles crossing the plane w = 0, with the vertices behind the viewer, and of
+	// triangles reaching past the guard band. Pixels closer to the clipped edges than the precision of the
+	// clipping are not compared.
+	bool test_clipping()
+	{
+		const int w = 128, h = 128;
+		UniformAttributes uniform;
+		Program program;
+		program.VertexShader = identity_vertex;
+		program.FragmentShader = color_fragment;
+		program.BlendingShader = replace_color;
+		FrameBuffer frameBuffer(w, h);
+
+		bool passed = true;
+		for (int scene = 0; scene < 2; ++scene)
+		{
+			const char* name = scene == 0 ? "near plane" : "guard band";
+			std::mt19937 rng(11 + scene);
+			std::uniform_real_distribution<float> unit(0.f, 1.f);
+			std::vector<VertexAttributes> triangles;
+			for (int t = 0; t < 300; ++t)
+			{
+				const int behind = 1 + t % 2, far = t % 3;
+				for (int k = 0; k < 3; ++k)
+				{
+					VertexAttributes v;
+					if (scene == 0)
+					{
+						// One or two vertices behind the viewer, the others in front of it
+						const float vw = k < behind ? -0.05f - unit(rng) : 0.3f + 1.2f * unit(rng);
+						v.position << (unit(rng) * 3 - 1.5f) * std::abs(vw), (unit(rng) * 3 - 1.5f) * std::abs(vw), 0, vw;
+					}
+					else
+					{
+						// One vertex past the guard band, 4 times the viewport
+						const float range = k == far ? 6 + 10 * unit(rng) : 1.2f;
+						v.position << (unit(rng) * 2 - 1) * range, (unit(rng) * 2 - 1) * range, 0, 1;
+					}
+					v.color << unit(rng), unit(rng), unit(rng), 1;
+					triangles.push_back(v);
+				}
+			}
+
+			// Coverage of the triangles clipped beforehand, and the pixels too close to a clipped edge
+			std::vector<int> expected(w * h, 0);
+			std::vector<bool> ignored(w * h, false);
+			std::vector<Eigen::Vector2d> polygon;
+			for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+			{
+				polygon.clear();
+				clip_polygon(&triangles[t], 1e-5, w, h, polygon);
+				for (size_t k = 1; k + 1 < polygon.size(); ++k)
+				{
+					const Eigen::Vector2f p[3] = { polygon[0].cast<float>(), polygon[k].cast<float>(), polygon[k + 1].cast<float>() };
+					for (int j = 0; j < h; ++j)
+						for (int i = 0; i < w; ++i)
+							expected[j * w + i] += exact_inside(p, i, j);
+				}
+				for (size_t k = 0; k < polygon.size(); ++k)
+				{
+					const Eigen::Vector2d a = polygon[k], d = polygon[(k + 1) % polygon.size()] - a;
+					const double length = d.norm();
+					for (int j = 0; j < h && length > 0; ++j)
+						for (int i = 0; i < w; ++i)
+							if (std::abs(d[0] * (j + 0.5 - a[1]) - d[1] * (i + 0.5 - a[0])) / length < 0.05)
+								ignored[j * w + i] = true;
+				}
+			}
+
+			const struct
+			{
+				const char* name;
+				std::function<void()> draw;
+			} paths[] = {
+				{ "one at a time", [&]() {
+					std::vector<VertexAttributes> one(3);
+					for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+					{
+						std::copy(triangles.begin() + t, triangles.begin() + t + 3, one.begin());
+						rasterize_triangles(program, uniform, one, frameBuffer);
+					}
+				} },
+				{ "binned", [&]() { rasterize_triangles(program, uniform, triangles, frameBuffer); } },
+			};
+			for (size_t k = 0; k < sizeof(paths) / sizeof(paths[0]); ++k)
+			{
+				const std::vector<int> counts = shaded_counts(paths[k].draw, w, h);
+				for (int p = 0; p < w * h; ++p)
+				{
+					if (!ignored[p] && counts[p] != expected[p])
+					{
+						std::cerr << name << ", " << paths[k].name << ": pixel (" << p % w << "," << p / w << ") covered "
+							<< counts[p] << " times instead of " << expected[p] << std::endl;
+						passed = false;
+						break;
+					}
+				}
+			}
+		}
+		return passed;
+	}
+
+	const struct
+	{
+		const char* name;
+		bool (*run)();
+	} TESTS[] = {
+		{ "coverage", test_coverage },
+		{ "depth", test_equal_depth },
+		{ "blend", test_blend },
+		{ "clipping", test_clipping },
+	};
+}
+
+int main(int argc, char *argv[])
+{
+	const std::string only = argc > 1 ? argv[1] : "";
+	bool found = false, passed = true;
+	for (size_t t = 0; t < sizeof(TESTS) / sizeof(TESTS[0]); ++t)
+	{
+		if (!only.empty() && only != TESTS[t].name)
+			continue;
+		found = true;
+		const bool ok = TESTS[t].run();
+		std::cout << (ok ? "passed " : "FAILED ") << TESTS[t].name << " (" << row_kernel_name() << ")" << std::endl;
+		passed = passed && ok;
+	}
+	if (!found)
+	{
+		std::cerr << "unknown test: " << only << std::endl;
+		return 1;
+	}
+	return passed ? 0 : 1;
+}
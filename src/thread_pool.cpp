@@ -0,0 +1,92 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+ThreadPool::ThreadPool(unsigned workers)
+	: task(nullptr), count(0), next(0), pending(0), generation(0), quit(false)
+{
+	for (unsigned i=0; i<workers; i++)
+		threads.push_back(std::thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (unsigned i=0; i<threads.size(); i++)
+		threads[i].join();
+}
+
+void ThreadPool::run(int count, const std::function<void(int)>& task)
+{
+	if (threads.empty() || count <= 1)
+	{
+		for (int i=0; i<count; i++)
+			task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		this->count = count;
+		next = 0;
+		pending = threads.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	// The calling thread works on the batch too
+	execute();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() { return pending == 0; });
+	this->task = nullptr;
+}
+
+unsigned ThreadPool::concurrency() const
+{
+	return threads.size()+1;
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool([]() {
+		const char* env = std::getenv("RASTER_THREADS");
+		int n = env ? std::atoi(env) : int(std::thread::hardware_concurrency());
+		return unsigned(std::max(n,1)-1);
+	}());
+	return pool;
+}
+
+void ThreadPool::work()
+{
+	unsigned seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen]() { return quit || generation != seen; });
+			if (quit)
+				return;
+			seen = generation;
+		}
+
+		execute();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--pending == 0)
+			done.notify_one();
+	}
+}
+
+void ThreadPool::execute()
+{
+	// Tasks are claimed one at a time, so uneven tasks balance across threads
+	for (int i = next++; i < count; i = next++)
+		(*task)(i);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads that execute batches of indexed tasks
+class ThreadPool
+{
+	public:
+	// Starts the given number of workers, 0 runs every task on the calling thread
+	explicit ThreadPool(unsigned workers);
+	~ThreadPool();
+
+	// Calls task(i) for every i in [0,count), spread over the workers and the calling thread.
+	// Returns once all tasks are done. Not reentrant: only one thread may submit at a time.
+	void run(int count, const std::function<void(int)>& task);
+
+	// Number of threads taking part in run(), including the calling thread
+	unsigned concurrency() const;
+
+	// Pool shared by the rasterizer, sized to the hardware concurrency unless
+	// the RASTER_THREADS environment variable sets the number of threads
+	static ThreadPool& shared();
+
+	private:
+	void work();
+	void execute();
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	// Current batch, published under the mutex by bumping generation
+	const std::function<void(int)>* task;
+	int count;
+	std::atomic<int> next;
+	unsigned pending;
+	unsigned generation;
+	bool quit;
+};